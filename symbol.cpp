@@ -258,6 +258,26 @@ std::string decode(Symbol symbol) throw() {
 	return symbol.decode();
 }
 
+static bool detect_avx2() throw() {
+#ifdef SYMBOL_AVX2_DISPATCH
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+static const bool avx2_supported = detect_avx2();
+static bool avx2_on = avx2_supported;
+
+bool avx2_enabled() throw() {
+	return __atomic_load_n(&avx2_on, __ATOMIC_RELAXED);
+}
+
+void set_avx2_enabled(bool enabled) throw() {
+	__atomic_store_n(&avx2_on, enabled && avx2_supported, __ATOMIC_RELAXED);
+}
+
 // make sure the symbol name consists only of allowed characters.
 bool validate(const std::string& identifier) throw() {
 	try {
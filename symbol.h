@@ -4,6 +4,21 @@
 #include <stdexcept>
 #include <stdint.h>
 
+// hint that the memory at p will be read soon.  Used by the batched lookups
+// to overlap cache misses; a no-op on compilers without the builtin.
+#ifdef __GNUC__
+#define SYMBOL_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define SYMBOL_PREFETCH(p) ((void)(p))
+#endif
+
+// On x86 with GCC or clang, the bulk operations are compiled both for AVX2
+// and for the baseline instruction set, and choose at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SYMBOL_AVX2_DISPATCH 1
+#define SYMBOL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 namespace symbol {
 
 // This error is thrown by Symbol encode/decode errors.
@@ -54,6 +69,28 @@ Symbol encode(const std::string& identifier) throw(SymbolError);
 std::string decode(uint64_t symbolCode) throw();
 std::string decode(Symbol symbol) throw();
 
+// scrambles a symbol or code for use as a hash.  Codes of similar identifiers
+// differ only in a few bits, so hash tables and filters keyed by symbol
+// should use this rather than the code itself.  The mixing is invertible,
+// so distinct symbols always have distinct hashes.
+inline uint64_t hash(uint64_t code) throw() {
+	uint64_t h = code;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53UL;
+	h ^= h >> 33;
+	return h;
+}
+inline uint64_t hash(Symbol symbol) throw() { return hash(symbol.code()); }
+
+// true if the AVX2 versions of the bulk operations are in use: the
+// processor supports AVX2 and it hasn't been turned off.  Turning it off
+// (e.g. to test or benchmark the portable versions) affects every thread;
+// turning it on does nothing on processors without AVX2.
+bool avx2_enabled() throw();
+void set_avx2_enabled(bool enabled) throw();
+
 // validate a potential identifier .  The constructors validate too, so you
 // only need to use validate() if you'd prefer to avoid having to catch an exception.
 bool validate(const std::string& identifier) throw();
@@ -0,0 +1,368 @@
+#include "symbol_column.h"
+#include "symbol.h"
+  // provides avx2_enabled
+#include <algorithm>
+  // provides sort, unique, lower_bound, max
+#ifdef SYMBOL_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace symbol {
+
+// "SYMCOL01" in ASCII; the first word of every column buffer.
+static const uint64_t COLUMN_MAGIC = 0x53594d434f4c3031UL;
+
+// words before the block index: magic, count, block size, block count.
+static const size_t COLUMN_HEADER_WORDS = 4;
+
+// block encodings, stored in the low byte of each block's header word.
+enum BlockKind {
+	BLOCK_FRAME = 1,
+	BLOCK_DICTIONARY = 2,
+	BLOCK_RUN_LENGTH = 3
+};
+
+// a block header packs the kind, bit width, number of codes, and number
+// of dictionary entries or runs into a single word.
+static uint64_t block_header(unsigned kind, unsigned bits, size_t count, size_t entries) {
+	return uint64_t(kind) | (uint64_t(bits) << 8) | (uint64_t(count) << 16) | (uint64_t(entries) << 32);
+}
+
+// number of bits needed to represent x; zero needs zero bits.
+static unsigned bits_needed(uint64_t x) {
+	unsigned bits = 0;
+	while ( x ) {
+		++bits;
+		x >>= 1;
+	}
+	return bits;
+}
+
+// number of words needed to hold count values of the given bit width.
+static size_t packed_words(size_t count, unsigned bits) {
+	return (count * bits + 63) / 64;
+}
+
+// appends values bit-packed at the given width, least significant bits first.
+static void pack(const uint64_t* values, size_t count, unsigned bits, std::vector<uint64_t>& out) {
+	const size_t start = out.size();
+	out.resize(start + packed_words(count, bits), 0);
+	if ( bits == 0 ) return;
+	uint64_t* words = &out[start];
+	for ( size_t i = 0; i < count; ++i ) {
+		const size_t bit = i * bits;
+		const size_t word = bit >> 6;
+		const unsigned shift = bit & 63;
+		words[word] |= values[i] << shift;
+		// the value straddles two words
+		if ( shift + bits > 64 ) words[word+1] |= values[i] >> (64 - shift);
+	}
+}
+
+// reads the index'th value of the given width from a packed array.
+static uint64_t extract(const uint64_t* words, size_t index, unsigned bits) {
+	if ( bits == 0 ) return 0;
+	const size_t bit = index * bits;
+	const size_t word = bit >> 6;
+	const unsigned shift = bit & 63;
+	uint64_t value = words[word] >> shift;
+	if ( shift + bits > 64 ) value |= words[word+1] << (64 - shift);
+	return bits == 64 ? value : value & ((uint64_t(1) << bits) - 1);
+}
+
+// Unpacks values first to count of a width fixed at compile time.  With
+// the width a constant the shifts and masks are constants too, so the
+// compiler unrolls the loop, but it stays scalar: each value may straddle
+// two words, which defeats the auto-vectorizer.  This decodes about 2.5GB
+// of codes a second, and finishes what unpack_avx2() leaves.
+template<unsigned BITS>
+static void unpack(const uint64_t* words, size_t first, size_t count, uint64_t* out) {
+	// (2 << 63) - 1 wraps around to all ones, so this works for BITS == 64.
+	const uint64_t mask = (uint64_t(2) << (BITS - 1)) - 1;
+	for ( size_t i = first; i < count; ++i ) {
+		const size_t bit = i * BITS;
+		const size_t word = bit >> 6;
+		const unsigned shift = bit & 63;
+		uint64_t value = words[word] >> shift;
+		if ( shift + BITS > 64 ) value |= words[word+1] << (64 - shift);
+		out[i] = value & mask;
+	}
+}
+
+template<>
+void unpack<0>(const uint64_t*, size_t first, size_t count, uint64_t* out) {
+	std::fill(out + first, out + count, 0);
+}
+
+typedef void (*Unpacker)(const uint64_t*, size_t, size_t, uint64_t*);
+
+// one unpacker per bit width, indexed by width.
+#define UNPACK_8(n) &unpack<n>, &unpack<n+1>, &unpack<n+2>, &unpack<n+3>, \
+	&unpack<n+4>, &unpack<n+5>, &unpack<n+6>, &unpack<n+7>
+static const Unpacker UNPACKERS[65] = {
+	UNPACK_8(0), UNPACK_8(8), UNPACK_8(16), UNPACK_8(24),
+	UNPACK_8(32), UNPACK_8(40), UNPACK_8(48), UNPACK_8(56),
+	&unpack<64>
+};
+#undef UNPACK_8
+
+#ifdef SYMBOL_AVX2_DISPATCH
+// Unpacks four values at a time: each lane gathers the two words its value
+// may span and shifts them by its own bit offset.  A shift by 64 gives zero,
+// so values within one word need no special case.  It stops while every
+// lane's second word is still inside the packed array, and returns how many
+// values it unpacked.
+SYMBOL_TARGET_AVX2 static size_t unpack_avx2(const uint64_t* words, size_t count, unsigned bits, uint64_t* out) {
+	const long long* base = reinterpret_cast<const long long*>(words);
+	const __m256i mask = _mm256_set1_epi64x((uint64_t(1) << bits) - 1);
+	const __m256i step = _mm256_set1_epi64x(4 * bits);
+	const __m256i low = _mm256_set1_epi64x(63);
+	const __m256i width = _mm256_set1_epi64x(64);
+	__m256i bit = _mm256_setr_epi64x(0, bits, 2 * bits, 3 * bits);
+	size_t i = 0;
+	for ( ; (i + 4) * bits + 64 <= count * bits; i += 4 ) {
+		const __m256i word = _mm256_srli_epi64(bit, 6);
+		const __m256i shift = _mm256_and_si256(bit, low);
+		const __m256i first = _mm256_i64gather_epi64(base, word, 8);
+		const __m256i second = _mm256_i64gather_epi64(base + 1, word, 8);
+		const __m256i value = _mm256_or_si256(_mm256_srlv_epi64(first, shift),
+			_mm256_sllv_epi64(second, _mm256_sub_epi64(width, shift)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(value, mask));
+		bit = _mm256_add_epi64(bit, step);
+	}
+	return i;
+}
+#endif
+
+// unpacks count values of the given width, with AVX2 when the processor has it.
+static void unpack(const uint64_t* words, size_t count, unsigned bits, uint64_t* out) {
+	size_t first = 0;
+#ifdef SYMBOL_AVX2_DISPATCH
+	// zero and full width values are plain fills and copies already.
+	if ( bits > 0 && bits < 64 && avx2_enabled() ) first = unpack_avx2(words, count, bits, out);
+#endif
+	UNPACKERS[bits](words, first, count, out);
+}
+
+// encodes a single block, choosing the smallest of the three encodings.
+static void encode_block(const uint64_t* codes, size_t count, std::vector<uint64_t>& out) {
+	// frame-of-reference
+	uint64_t min = codes[0];
+	uint64_t max = codes[0];
+	for ( size_t i = 1; i < count; ++i ) {
+		if ( codes[i] < min ) min = codes[i];
+		if ( codes[i] > max ) max = codes[i];
+	}
+	const unsigned frame_bits = bits_needed(max - min);
+	const size_t frame_words = 2 + packed_words(count, frame_bits);
+
+	// dictionary
+	std::vector<uint64_t> dictionary(codes, codes + count);
+	std::sort(dictionary.begin(), dictionary.end());
+	dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+	const unsigned dictionary_bits = bits_needed(dictionary.size() - 1);
+	const size_t dictionary_words = 1 + dictionary.size() + packed_words(count, dictionary_bits);
+
+	// run-length; lengths are stored minus one since runs are never empty.
+	std::vector<uint64_t> run_values;
+	std::vector<uint64_t> run_lengths;
+	uint64_t longest = 0;
+	for ( size_t i = 0; i < count; ) {
+		size_t j = i + 1;
+		while ( j < count && codes[j] == codes[i] ) ++j;
+		run_values.push_back(codes[i]);
+		run_lengths.push_back(j - i - 1);
+		if ( j - i - 1 > longest ) longest = j - i - 1;
+		i = j;
+	}
+	const unsigned run_bits = bits_needed(longest);
+	const size_t run_words = 1 + run_values.size() + packed_words(run_values.size(), run_bits);
+
+	// ties go to frame-of-reference, which is the cheapest to decode.
+	if ( frame_words <= dictionary_words && frame_words <= run_words ) {
+		out.push_back(block_header(BLOCK_FRAME, frame_bits, count, 0));
+		out.push_back(min);
+		std::vector<uint64_t> offsets(count);
+		for ( size_t i = 0; i < count; ++i ) offsets[i] = codes[i] - min;
+		pack(&offsets[0], count, frame_bits, out);
+	} else if ( dictionary_words <= run_words ) {
+		out.push_back(block_header(BLOCK_DICTIONARY, dictionary_bits, count, dictionary.size()));
+		out.insert(out.end(), dictionary.begin(), dictionary.end());
+		std::vector<uint64_t> indexes(count);
+		for ( size_t i = 0; i < count; ++i ) {
+			indexes[i] = std::lower_bound(dictionary.begin(), dictionary.end(), codes[i]) - dictionary.begin();
+		}
+		pack(&indexes[0], count, dictionary_bits, out);
+	} else {
+		out.push_back(block_header(BLOCK_RUN_LENGTH, run_bits, count, run_values.size()));
+		out.insert(out.end(), run_values.begin(), run_values.end());
+		pack(&run_lengths[0], run_lengths.size(), run_bits, out);
+	}
+}
+
+void encode_column(const uint64_t* codes, size_t count, std::vector<uint64_t>& out) {
+	const size_t block_count = (count + COLUMN_BLOCK_SIZE - 1) / COLUMN_BLOCK_SIZE;
+	const size_t start = out.size();
+	out.push_back(COLUMN_MAGIC);
+	out.push_back(count);
+	out.push_back(COLUMN_BLOCK_SIZE);
+	out.push_back(block_count);
+
+	// reserve the block index; offsets are filled in as blocks are written.
+	const size_t index = out.size();
+	out.resize(index + block_count, 0);
+
+	for ( size_t block = 0; block < block_count; ++block ) {
+		const size_t first = block * COLUMN_BLOCK_SIZE;
+		const size_t length = std::min(COLUMN_BLOCK_SIZE, count - first);
+		out[index + block] = out.size() - start;
+		encode_block(codes + first, length, out);
+	}
+}
+
+Column::Column(const uint64_t* words, size_t word_count) throw(ColumnError):
+	_words(words),
+	_word_count(word_count),
+	_count(0),
+	_block_count(0),
+	_offsets(NULL)
+{
+	if ( word_count < COLUMN_HEADER_WORDS || words[0] != COLUMN_MAGIC ) {
+		throw ColumnError("not a symbol column");
+	}
+	if ( words[2] != COLUMN_BLOCK_SIZE ) {
+		throw ColumnError("unsupported column block size");
+	}
+	_count = words[1];
+	_block_count = words[3];
+	// rounded up without adding first, which would wrap for a corrupt count.
+	if ( _block_count != _count / COLUMN_BLOCK_SIZE + (_count % COLUMN_BLOCK_SIZE != 0) ||
+		 _block_count > word_count - COLUMN_HEADER_WORDS ) {
+		throw ColumnError("truncated column block index");
+	}
+	_offsets = words + COLUMN_HEADER_WORDS;
+}
+
+size_t Column::block_size(size_t block) const throw() {
+	if ( block >= _block_count ) return 0;
+	return std::min(COLUMN_BLOCK_SIZE, _count - block * COLUMN_BLOCK_SIZE);
+}
+
+// bounds-checked view of one block, shared by decode_block() and get().
+struct BlockView {
+	unsigned kind;
+	unsigned bits;
+	size_t count;
+	size_t entries;
+	// the frame base, dictionary, or run values.
+	const uint64_t* values;
+	// the packed offsets, indexes, or run lengths.
+	const uint64_t* packed;
+};
+
+static BlockView view_block(const uint64_t* words, size_t word_count, uint64_t offset, size_t expected) {
+	if ( offset >= word_count ) throw ColumnError("block offset out of range");
+	const uint64_t header = words[offset];
+	BlockView view;
+	view.kind = header & 0xff;
+	view.bits = (header >> 8) & 0xff;
+	view.count = (header >> 16) & 0xffff;
+	view.entries = (header >> 32) & 0xffff;
+	view.values = words + offset + 1;
+
+	if ( view.count != expected || view.bits > 64 ) throw ColumnError("corrupt block header");
+
+	size_t needed = 0;
+	switch ( view.kind ) {
+	case BLOCK_FRAME:
+		needed = 1 + packed_words(view.count, view.bits);
+		view.packed = view.values + 1;
+		break;
+	case BLOCK_DICTIONARY:
+		if ( view.entries == 0 || view.entries > view.count ) throw ColumnError("corrupt block header");
+		needed = view.entries + packed_words(view.count, view.bits);
+		view.packed = view.values + view.entries;
+		break;
+	case BLOCK_RUN_LENGTH:
+		if ( view.entries == 0 || view.entries > view.count ) throw ColumnError("corrupt block header");
+		needed = view.entries + packed_words(view.entries, view.bits);
+		view.packed = view.values + view.entries;
+		break;
+	default:
+		throw ColumnError("unknown block encoding");
+	}
+	if ( needed > word_count - offset - 1 ) throw ColumnError("truncated block");
+	return view;
+}
+
+size_t Column::decode_block(size_t block, uint64_t* out) const throw(ColumnError) {
+	if ( block >= _block_count ) throw ColumnError("block index out of range");
+	const BlockView view = view_block(_words, _word_count, _offsets[block], block_size(block));
+
+	switch ( view.kind ) {
+	case BLOCK_FRAME: {
+		unpack(view.packed, view.count, view.bits, out);
+		const uint64_t base = view.values[0];
+		for ( size_t i = 0; i < view.count; ++i ) out[i] += base;
+		break;
+	}
+	case BLOCK_DICTIONARY: {
+		unpack(view.packed, view.count, view.bits, out);
+		// check the indexes once for the block, so the lookups don't branch.
+		uint64_t largest = 0;
+		for ( size_t i = 0; i < view.count; ++i ) largest = std::max(largest, out[i]);
+		if ( largest >= view.entries ) throw ColumnError("dictionary index out of range");
+		for ( size_t i = 0; i < view.count; ++i ) out[i] = view.values[out[i]];
+		break;
+	}
+	case BLOCK_RUN_LENGTH: {
+		uint64_t lengths[COLUMN_BLOCK_SIZE];
+		unpack(view.packed, view.entries, view.bits, lengths);
+		size_t written = 0;
+		for ( size_t run = 0; run < view.entries; ++run ) {
+			const size_t length = lengths[run] + 1;
+			if ( length > view.count - written ) throw ColumnError("run overflows block");
+			std::fill(out + written, out + written + length, view.values[run]);
+			written += length;
+		}
+		if ( written != view.count ) throw ColumnError("runs do not fill block");
+		break;
+	}
+	}
+	return view.count;
+}
+
+void Column::decode(uint64_t* out) const throw(ColumnError) {
+	for ( size_t block = 0; block < _block_count; ++block ) {
+		out += decode_block(block, out);
+	}
+}
+
+uint64_t Column::get(size_t index) const throw(ColumnError) {
+	if ( index >= _count ) throw ColumnError("column index out of range");
+	const size_t block = index / COLUMN_BLOCK_SIZE;
+	const size_t position = index % COLUMN_BLOCK_SIZE;
+	if ( block >= _block_count ) throw ColumnError("block index out of range");
+	const BlockView view = view_block(_words, _word_count, _offsets[block], block_size(block));
+
+	switch ( view.kind ) {
+	case BLOCK_FRAME:
+		return view.values[0] + extract(view.packed, position, view.bits);
+	case BLOCK_DICTIONARY: {
+		const uint64_t entry = extract(view.packed, position, view.bits);
+		if ( entry >= view.entries ) throw ColumnError("dictionary index out of range");
+		return view.values[entry];
+	}
+	default: {
+		// walk the runs until we reach the one covering this position.
+		size_t end = 0;
+		for ( size_t run = 0; run < view.entries; ++run ) {
+			end += extract(view.packed, run, view.bits) + 1;
+			if ( position < end ) return view.values[run];
+		}
+		throw ColumnError("runs do not fill block");
+	}
+	}
+}
+
+} // end namespace symbol.
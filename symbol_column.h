@@ -0,0 +1,64 @@
+#ifndef SYMBOL_COLUMN_H
+#define SYMBOL_COLUMN_H
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// This error is thrown when a column buffer is truncated or malformed.
+class ColumnError: public std::runtime_error {
+public:
+	explicit ColumnError(const std::string& message): std::runtime_error(message) {}
+};
+
+// number of codes in each independently encoded block of a column.
+const size_t COLUMN_BLOCK_SIZE = 256;
+
+// Compresses an array of symbol codes into a column buffer, appending it to
+// the output.  The column is split into blocks of COLUMN_BLOCK_SIZE codes and
+// each block is stored as whichever of these is smallest:
+//   frame-of-reference: the block minimum plus bit-packed offsets from it,
+//   dictionary: the sorted distinct codes plus bit-packed indexes into them,
+//   run-length: the value of each run plus bit-packed run lengths.
+// The buffer is a sequence of native-endian 64-bit words so it can be
+// written to disk or sent over the wire as-is.
+void encode_column(const uint64_t* codes, size_t count, std::vector<uint64_t>& out);
+
+// Read-only view of a column buffer produced by encode_column().  The
+// buffer is not copied and must outlive the Column.  The constructor only
+// checks the header and block index; blocks are decoded on demand.
+class Column {
+	const uint64_t* _words;
+	size_t _word_count;
+	size_t _count;
+	size_t _block_count;
+	const uint64_t* _offsets;
+
+public:
+	Column(const uint64_t* words, size_t word_count) throw(ColumnError);
+
+	// number of codes in the column.
+	size_t size() const throw() { return _count; }
+
+	// number of blocks; every block but the last holds COLUMN_BLOCK_SIZE codes.
+	size_t block_count() const throw() { return _block_count; }
+
+	// number of codes in the given block.
+	size_t block_size(size_t block) const throw();
+
+	// decodes one block into out, which must hold block_size(block) codes.
+	// returns the number of codes written.
+	size_t decode_block(size_t block, uint64_t* out) const throw(ColumnError);
+
+	// decodes the whole column into out, which must hold size() codes.
+	void decode(uint64_t* out) const throw(ColumnError);
+
+	// random access to a single code without decoding its whole block.
+	uint64_t get(size_t index) const throw(ColumnError);
+};
+
+}
+#endif
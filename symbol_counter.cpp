@@ -0,0 +1,439 @@
+#include "symbol_counter.h"
+#include "symbol_guard.h"
+  // provides Guard
+#include <algorithm>
+  // provides sort, partial_sort, unique
+#include <stdexcept>
+  // provides invalid_argument
+#include <pthread.h>
+
+namespace symbol {
+
+// number of rows in each count-min sketch.
+static const size_t SKETCH_DEPTH = 4;
+
+// Open-addressing hash table from codes to counts.  A zero count marks an
+// empty slot, so the empty symbol (code zero) needs no special case.
+class CountTable {
+	std::vector<uint64_t> _keys;
+	std::vector<uint64_t> _counts;
+	size_t _used;
+
+	void grow() {
+		std::vector<uint64_t> keys(_keys.size() * 2);
+		std::vector<uint64_t> counts(_counts.size() * 2);
+		keys.swap(_keys);
+		counts.swap(_counts);
+		_used = 0;
+		for ( size_t i = 0; i < keys.size(); ++i ) {
+			if ( counts[i] ) add(keys[i], counts[i]);
+		}
+	}
+
+public:
+	CountTable(): _keys(16), _counts(16), _used(0) {}
+
+	void add(uint64_t key, uint64_t count) {
+		if ( count == 0 ) return;
+		// keep the load at most one half.
+		if ( (_used + 1) * 2 > _keys.size() ) grow();
+		const size_t mask = _keys.size() - 1;
+		for ( size_t i = hash(key) & mask; ; i = (i + 1) & mask ) {
+			if ( _counts[i] == 0 ) {
+				_keys[i] = key;
+				_counts[i] = count;
+				++_used;
+				return;
+			} else if ( _keys[i] == key ) {
+				_counts[i] += count;
+				return;
+			}
+		}
+	}
+
+	uint64_t get(uint64_t key) const {
+		const size_t mask = _keys.size() - 1;
+		for ( size_t i = hash(key) & mask; _counts[i] != 0; i = (i + 1) & mask ) {
+			if ( _keys[i] == key ) return _counts[i];
+		}
+		return 0;
+	}
+
+	// adds every count in other to this table.
+	void add_all(const CountTable& other) {
+		for ( size_t i = 0; i < other._keys.size(); ++i ) {
+			if ( other._counts[i] ) add(other._keys[i], other._counts[i]);
+		}
+	}
+
+	// appends every (code, count) pair to out.
+	void list(std::vector<std::pair<uint64_t, uint64_t> >& out) const {
+		for ( size_t i = 0; i < _keys.size(); ++i ) {
+			if ( _counts[i] ) out.push_back(std::make_pair(_keys[i], _counts[i]));
+		}
+	}
+
+	void clear() {
+		std::vector<uint64_t>(16).swap(_keys);
+		std::vector<uint64_t>(16).swap(_counts);
+		_used = 0;
+	}
+};
+
+// the cell of a count-min sketch row that counts a key with the given hash.
+// row indexes are derived from two halves of one hash (Kirsch-Mitzenmacher).
+static size_t sketch_cell(uint64_t h, size_t row, size_t width) {
+	const uint64_t h1 = h & 0xffffffff;
+	const uint64_t h2 = (h >> 32) | 1;
+	return row * width + ((h1 + row * h2) & (width - 1));
+}
+
+// the count-min estimate of a key: the smallest of its cells.
+static uint64_t sketch_estimate(const std::vector<uint64_t>& sketch, size_t width, uint64_t key) {
+	const uint64_t h = hash(key);
+	uint64_t estimate = sketch[sketch_cell(h, 0, width)];
+	for ( size_t row = 1; row < SKETCH_DEPTH; ++row ) {
+		estimate = std::min(estimate, sketch[sketch_cell(h, row, width)]);
+	}
+	return estimate;
+}
+
+// orders (code, count) pairs most frequent first, then by code.
+static bool more_frequent(const std::pair<uint64_t, uint64_t>& lhs, const std::pair<uint64_t, uint64_t>& rhs) {
+	if ( lhs.second != rhs.second ) return lhs.second > rhs.second;
+	return lhs.first < rhs.first;
+}
+
+// The heavy-hitter candidates of an approximate shard: a min-heap of
+// keys by estimate, so the smallest is always at hand for eviction, plus an
+// open-addressing index from key to heap position, so updating a candidate
+// costs a hash probe and a short sift instead of a scan of every candidate.
+class CandidateHeap {
+	size_t _capacity;
+	// heap order: _estimates[i] <= the estimates of i's children.
+	std::vector<uint64_t> _keys;
+	std::vector<uint64_t> _estimates;
+	// the index slot of each heap entry.
+	std::vector<size_t> _slots;
+	// index slots hold heap position + 1; zero marks an empty slot.
+	std::vector<size_t> _index;
+
+	size_t home(uint64_t key) const { return hash(key) & (_index.size() - 1); }
+
+	// the index slot of key, or the empty slot where it would go.
+	size_t find(uint64_t key) const {
+		const size_t mask = _index.size() - 1;
+		size_t i = home(key);
+		while ( _index[i] && _keys[_index[i] - 1] != key ) i = (i + 1) & mask;
+		return i;
+	}
+
+	// empties an index slot, shifting later entries of its probe run back
+	// into it so lookups never stop at a gap too early.
+	void erase_slot(size_t i) {
+		const size_t mask = _index.size() - 1;
+		_index[i] = 0;
+		for ( size_t j = (i + 1) & mask; _index[j]; j = (j + 1) & mask ) {
+			// an entry may move back to i only if its home isn't in (i, j].
+			const size_t k = home(_keys[_index[j] - 1]);
+			if ( ((j - k) & mask) >= ((j - i) & mask) ) {
+				_index[i] = _index[j];
+				_slots[_index[i] - 1] = i;
+				_index[j] = 0;
+				i = j;
+			}
+		}
+	}
+
+	void swap_entries(size_t a, size_t b) {
+		std::swap(_keys[a], _keys[b]);
+		std::swap(_estimates[a], _estimates[b]);
+		std::swap(_slots[a], _slots[b]);
+		_index[_slots[a]] = a + 1;
+		_index[_slots[b]] = b + 1;
+	}
+
+	void sift_up(size_t i) {
+		while ( i > 0 && _estimates[(i - 1) / 2] > _estimates[i] ) {
+			swap_entries(i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	}
+
+	void sift_down(size_t i) {
+		for ( ;; ) {
+			size_t smallest = i;
+			const size_t left = 2 * i + 1;
+			if ( left < _keys.size() && _estimates[left] < _estimates[smallest] ) smallest = left;
+			if ( left + 1 < _keys.size() && _estimates[left + 1] < _estimates[smallest] ) smallest = left + 1;
+			if ( smallest == i ) return;
+			swap_entries(i, smallest);
+			i = smallest;
+		}
+	}
+
+public:
+	explicit CandidateHeap(size_t capacity): _capacity(capacity) {
+		size_t slots = 4;
+		while ( slots < 2 * capacity ) slots *= 2;
+		_index.assign(slots, 0);
+	}
+
+	const std::vector<uint64_t>& keys() const { return _keys; }
+
+	// offers a key with its latest estimate, evicting the smallest if full.
+	void offer(uint64_t key, uint64_t estimate) {
+		if ( _capacity == 0 ) return;
+		// keys estimated at or below the smallest can't displace any candidate.
+		if ( _keys.size() == _capacity && estimate <= _estimates[0] ) return;
+		const size_t slot = find(key);
+		if ( _index[slot] ) {
+			const size_t i = _index[slot] - 1;
+			_estimates[i] = estimate;
+			sift_up(i);
+			sift_down(i);
+		} else if ( _keys.size() < _capacity ) {
+			_keys.push_back(key);
+			_estimates.push_back(estimate);
+			_slots.push_back(slot);
+			_index[slot] = _keys.size();
+			sift_up(_keys.size() - 1);
+		} else {
+			erase_slot(_slots[0]);
+			// erasing may have moved key's empty slot back.
+			const size_t empty = find(key);
+			_keys[0] = key;
+			_estimates[0] = estimate;
+			_slots[0] = empty;
+			_index[empty] = 1;
+			sift_down(0);
+		}
+	}
+
+	void clear() {
+		_keys.clear();
+		_estimates.clear();
+		_slots.clear();
+		std::fill(_index.begin(), _index.end(), 0);
+	}
+};
+
+class SymbolCounter::Shard {
+public:
+	pthread_mutex_t mutex;
+
+	// EXACT mode
+	CountTable table;
+
+	// APPROXIMATE mode: a SKETCH_DEPTH by width count-min sketch, and the
+	// heavy-hitter candidates with their estimates when last seen.
+	size_t width;
+	std::vector<uint64_t> sketch;
+	CandidateHeap candidates;
+
+	// nonzero while a thread has claimed the shard as its own.
+	unsigned held;
+
+	// shards are updated by different threads; keep them on separate cache lines.
+	char padding[64];
+
+	Shard(Mode mode, size_t sketch_width, size_t candidate_capacity):
+		width(sketch_width),
+		sketch(mode == APPROXIMATE ? SKETCH_DEPTH * sketch_width : 0),
+		candidates(mode == APPROXIMATE ? candidate_capacity : 0),
+		held(0)
+	{
+		pthread_mutex_init(&mutex, NULL);
+	}
+
+	~Shard() {
+		pthread_mutex_destroy(&mutex);
+	}
+
+	// adds to the sketch and returns the key's new estimate.
+	uint64_t add_to_sketch(uint64_t key, uint64_t count) {
+		const uint64_t h = hash(key);
+		uint64_t estimate = 0;
+		for ( size_t row = 0; row < SKETCH_DEPTH; ++row ) {
+			uint64_t& cell = sketch[sketch_cell(h, row, width)];
+			cell += count;
+			if ( row == 0 || cell < estimate ) estimate = cell;
+		}
+		return estimate;
+	}
+
+	// callers must hold the mutex.
+	void add(Mode mode, uint64_t key, uint64_t count) {
+		if ( mode == EXACT ) {
+			table.add(key, count);
+		} else if ( count > 0 ) {
+			candidates.offer(key, add_to_sketch(key, count));
+		}
+	}
+
+	void clear() {
+		Guard guard(mutex);
+		table.clear();
+		std::fill(sketch.begin(), sketch.end(), 0);
+		candidates.clear();
+	}
+};
+
+SymbolCounter::SymbolCounter(Mode mode, size_t shards, size_t sketch_width, size_t candidates):
+	_mode(mode),
+	_sketch_width(1),
+	_keyed(pthread_key_create(&_key, release_shard) == 0),
+	_next_shared(0)
+{
+	while ( _sketch_width < sketch_width ) _sketch_width <<= 1;
+	if ( shards == 0 ) shards = 1;
+	for ( size_t i = 0; i < shards; ++i ) {
+		_shards.push_back(new Shard(mode, _sketch_width, candidates));
+	}
+}
+
+SymbolCounter::~SymbolCounter() {
+	if ( _keyed ) pthread_key_delete(_key);
+	for ( size_t i = 0; i < _shards.size(); ++i ) delete _shards[i];
+}
+
+// A thread's key value is the shard it claimed, or the shard it shares
+// with its low bit set if every shard was claimed when it first looked.
+void SymbolCounter::release_shard(void* value) {
+	const uintptr_t bits = reinterpret_cast<uintptr_t>(value);
+	if ( bits & 1 ) return;
+	__atomic_store_n(&reinterpret_cast<Shard*>(bits)->held, 0, __ATOMIC_RELEASE);
+}
+
+SymbolCounter::Shard& SymbolCounter::local_shard() {
+	// without a key no thread can keep a shard, so every call shares them in turn.
+	if ( !_keyed ) return *_shards[__atomic_fetch_add(&_next_shared, 1, __ATOMIC_RELAXED) % _shards.size()];
+
+	const uintptr_t bits = reinterpret_cast<uintptr_t>(pthread_getspecific(_key));
+	if ( bits ) return *reinterpret_cast<Shard*>(bits & ~uintptr_t(1));
+
+	for ( size_t i = 0; i < _shards.size(); ++i ) {
+		unsigned released = 0;
+		if ( __atomic_compare_exchange_n(&_shards[i]->held, &released, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) {
+			if ( pthread_setspecific(_key, _shards[i]) != 0 ) release_shard(_shards[i]);
+			return *_shards[i];
+		}
+	}
+	// more threads than shards: share them out in turn.
+	Shard* shard = _shards[__atomic_fetch_add(&_next_shared, 1, __ATOMIC_RELAXED) % _shards.size()];
+	pthread_setspecific(_key, reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(shard) | 1));
+	return *shard;
+}
+
+void SymbolCounter::increment(Symbol key, uint64_t count) {
+	Shard& shard = local_shard();
+	Guard guard(shard.mutex);
+	shard.add(_mode, key.code(), count);
+}
+
+void SymbolCounter::increment_many(const Symbol* keys, size_t n) {
+	Shard& shard = local_shard();
+	Guard guard(shard.mutex);
+	for ( size_t i = 0; i < n; ++i ) shard.add(_mode, keys[i].code(), 1);
+}
+
+uint64_t SymbolCounter::count(Symbol key) const {
+	if ( _mode == EXACT ) {
+		uint64_t total = 0;
+		for ( size_t i = 0; i < _shards.size(); ++i ) {
+			Guard guard(_shards[i]->mutex);
+			total += _shards[i]->table.get(key.code());
+		}
+		return total;
+	}
+
+	// sum each of the key's cells over the shards, then take the smallest.
+	const uint64_t h = hash(key);
+	uint64_t totals[SKETCH_DEPTH] = { 0 };
+	for ( size_t i = 0; i < _shards.size(); ++i ) {
+		Guard guard(_shards[i]->mutex);
+		for ( size_t row = 0; row < SKETCH_DEPTH; ++row ) {
+			totals[row] += _shards[i]->sketch[sketch_cell(h, row, _sketch_width)];
+		}
+	}
+	return *std::min_element(totals, totals + SKETCH_DEPTH);
+}
+
+// Snapshots of every shard merged together, used by top() and merge().
+// For an EXACT counter only the table is filled in; otherwise the sketch
+// and the union of all candidates.
+struct SymbolCounter::Totals {
+	CountTable table;
+	std::vector<uint64_t> sketch;
+	std::vector<uint64_t> candidates;
+};
+
+void SymbolCounter::merge(const SymbolCounter& other) {
+	if ( other._mode != _mode ) {
+		throw std::invalid_argument("can't merge exact and approximate symbol counters");
+	}
+	if ( _mode == APPROXIMATE && other._sketch_width != _sketch_width ) {
+		throw std::invalid_argument("can't merge symbol counters with different sketch widths");
+	}
+
+	// snapshot first, so merging a counter into itself doesn't deadlock.
+	Totals totals;
+	other.collect(totals);
+
+	Shard& shard = local_shard();
+	Guard guard(shard.mutex);
+	if ( _mode == EXACT ) {
+		shard.table.add_all(totals.table);
+	} else {
+		// count-min sketches of the same shape merge by adding cells.
+		for ( size_t i = 0; i < shard.sketch.size(); ++i ) shard.sketch[i] += totals.sketch[i];
+		for ( size_t i = 0; i < totals.candidates.size(); ++i ) {
+			const uint64_t key = totals.candidates[i];
+			shard.candidates.offer(key, sketch_estimate(shard.sketch, _sketch_width, key));
+		}
+	}
+}
+
+void SymbolCounter::top(size_t k, std::vector<std::pair<Symbol, uint64_t> >& out) const {
+	Totals totals;
+	collect(totals);
+
+	std::vector<std::pair<uint64_t, uint64_t> > counts;
+	if ( _mode == EXACT ) {
+		totals.table.list(counts);
+	} else {
+		for ( size_t i = 0; i < totals.candidates.size(); ++i ) {
+			const uint64_t key = totals.candidates[i];
+			counts.push_back(std::make_pair(key, sketch_estimate(totals.sketch, _sketch_width, key)));
+		}
+	}
+
+	k = std::min(k, counts.size());
+	std::partial_sort(counts.begin(), counts.begin() + k, counts.end(), more_frequent);
+	out.clear();
+	for ( size_t i = 0; i < k; ++i ) {
+		out.push_back(std::make_pair(Symbol(counts[i].first), counts[i].second));
+	}
+}
+
+void SymbolCounter::clear() {
+	for ( size_t i = 0; i < _shards.size(); ++i ) _shards[i]->clear();
+}
+
+void SymbolCounter::collect(Totals& totals) const {
+	if ( _mode == APPROXIMATE ) totals.sketch.assign(SKETCH_DEPTH * _sketch_width, 0);
+	for ( size_t i = 0; i < _shards.size(); ++i ) {
+		Shard& shard = *_shards[i];
+		Guard guard(shard.mutex);
+		if ( _mode == EXACT ) {
+			totals.table.add_all(shard.table);
+		} else {
+			for ( size_t j = 0; j < shard.sketch.size(); ++j ) totals.sketch[j] += shard.sketch[j];
+			totals.candidates.insert(totals.candidates.end(), shard.candidates.keys().begin(), shard.candidates.keys().end());
+		}
+	}
+	std::sort(totals.candidates.begin(), totals.candidates.end());
+	totals.candidates.erase(std::unique(totals.candidates.begin(), totals.candidates.end()), totals.candidates.end());
+}
+
+} // end namespace symbol.
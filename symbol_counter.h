@@ -0,0 +1,91 @@
+#ifndef SYMBOL_COUNTER_H
+#define SYMBOL_COUNTER_H
+#include "symbol.h"
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// Counts occurrences of symbols from many threads at once.
+//
+// Counts are kept in shards.  Each thread claims a free shard the first
+// time it increments and hands it back when it exits, so threads never
+// contend as long as no more threads than shards are counting at once.
+// Threads beyond that share shards in turn.  Reads (count, top) merge the
+// shards.
+//
+// Each counter uses one of the process's PTHREAD_KEYS_MAX thread-specific
+// keys (1024 with glibc) for as long as it exists.  If none is left, the
+// counter still counts correctly, but every increment takes the next shard
+// in turn, so threads contend.
+//
+// In EXACT mode each shard is a hash table of every symbol seen.  In
+// APPROXIMATE mode memory is bounded instead: each shard is a count-min
+// sketch, whose counts may be overestimates but never underestimates,
+// plus a fixed number of heavy-hitter candidates for top().
+class SymbolCounter {
+public:
+	enum Mode { EXACT, APPROXIMATE };
+
+	// shards is the number of independent tables.  For APPROXIMATE mode,
+	// sketch_width is the number of counters per sketch row (rounded up to
+	// a power of two) and candidates bounds how many keys top() can return.
+	explicit SymbolCounter(Mode mode = EXACT, size_t shards = 32,
+		size_t sketch_width = 4096, size_t candidates = 256);
+	~SymbolCounter();
+
+	Mode mode() const throw() { return _mode; }
+
+	// adds count occurrences of key to the calling thread's shard.
+	void increment(Symbol key, uint64_t count = 1);
+
+	// adds one occurrence of each key, locking the shard once for the batch.
+	void increment_many(const Symbol* keys, size_t n);
+
+	// total occurrences of key over all shards.
+	uint64_t count(Symbol key) const;
+
+	// adds all of other's counts to this counter.  Both must be in the same
+	// mode, and approximate counters must have the same sketch width.
+	void merge(const SymbolCounter& other);
+
+	// replaces out with the k most frequent keys and their counts, most
+	// frequent first.  Ties are broken by symbol order.
+	void top(size_t k, std::vector<std::pair<Symbol, uint64_t> >& out) const;
+
+	// resets every count to zero.
+	void clear();
+
+private:
+	class Shard;
+	struct Totals;
+
+	Mode _mode;
+	size_t _sketch_width;
+	std::vector<Shard*> _shards;
+
+	// each thread's shard, through _key, and where threads without a shard
+	// of their own share next.  _keyed is false if no key was available.
+	pthread_key_t _key;
+	bool _keyed;
+	size_t _next_shared;
+
+	// the shard assigned to the calling thread.
+	Shard& local_shard();
+
+	// the _key destructor: hands an exiting thread's shard back.
+	static void release_shard(void* value);
+
+	// snapshots all shards merged together.
+	void collect(Totals& totals) const;
+
+	// a copy would share _key and the shard pointers, and free both twice.
+	SymbolCounter(const SymbolCounter&);
+	SymbolCounter& operator=(const SymbolCounter&);
+};
+
+}
+#endif
@@ -0,0 +1,161 @@
+#include "symbol_dictionary.h"
+#include <fstream>
+#include <string.h>
+  // provides strnlen
+#include <fcntl.h>
+  // provides open
+#include <sys/mman.h>
+  // provides mmap, munmap
+#include <sys/stat.h>
+  // provides fstat
+#include <unistd.h>
+  // provides close
+
+namespace symbol {
+
+// "SYMDICT1" in ASCII; the first word of every dictionary file.
+static const uint64_t DICTIONARY_MAGIC = 0x31544349444d5953UL;
+
+// words before the hash table: magic, slot count, candidate count, pool size.
+static const size_t HEADER_WORDS = 4;
+
+// identifiers of this length or less are encoded exactly.
+static const size_t EXACT_LENGTH = 10;
+
+static bool is_identifier_char(char c) {
+	return c == '_' || ('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+bool DictionaryBuilder::add(const std::string& identifier) {
+	if ( !validate(identifier) ) return false;
+	Symbol symbol(identifier);
+	// a decoded lossy symbol re-encodes to itself, and tells us nothing new.
+	if ( symbol.is_lossy() && symbol.decode() != identifier ) {
+		_identifiers[symbol.code()].insert(identifier);
+	}
+	return true;
+}
+
+size_t DictionaryBuilder::add_text(const std::string& text) {
+	size_t found = 0;
+	size_t i = 0;
+	while ( i < text.size() ) {
+		if ( !is_identifier_char(text[i]) ) {
+			++i;
+			continue;
+		}
+		size_t end = i + 1;
+		while ( end < text.size() && is_identifier_char(text[end]) ) ++end;
+		if ( end - i > EXACT_LENGTH && add(text.substr(i, end - i)) ) ++found;
+		i = end;
+	}
+	return found;
+}
+
+void DictionaryBuilder::write(const std::string& path) const throw(DictionaryError) {
+	// keep the table at most half full so probe sequences stay short.
+	uint64_t slot_count = 16;
+	while ( slot_count < 2 * _identifiers.size() ) slot_count *= 2;
+
+	std::vector<uint64_t> slots(2 * slot_count, 0);
+	std::vector<uint32_t> candidates;
+	std::string pool;
+	typedef std::map<uint64_t, std::set<std::string> >::const_iterator Iterator;
+	for ( Iterator it = _identifiers.begin(); it != _identifiers.end(); ++it ) {
+		// lossy codes are never zero, so a zero code marks an empty slot.
+		uint64_t i = hash(it->first) & (slot_count - 1);
+		while ( slots[2 * i] != 0 ) i = (i + 1) & (slot_count - 1);
+		slots[2 * i] = it->first;
+		slots[2 * i + 1] = (uint64_t(candidates.size()) << 32) | it->second.size();
+
+		for ( std::set<std::string>::const_iterator s = it->second.begin(); s != it->second.end(); ++s ) {
+			candidates.push_back(pool.size());
+			pool += *s;
+			pool += '\0';
+		}
+	}
+	// keep the pool 8-byte aligned.
+	if ( candidates.size() % 2 ) candidates.push_back(0);
+
+	const uint64_t header[HEADER_WORDS] = { DICTIONARY_MAGIC, slot_count, candidates.size(), pool.size() };
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(&slots[0]), slots.size() * sizeof(uint64_t));
+	if ( !candidates.empty() ) out.write(reinterpret_cast<const char*>(&candidates[0]), candidates.size() * sizeof(uint32_t));
+	out.write(pool.data(), pool.size());
+	out.close();
+	if ( !out ) throw DictionaryError("unable to write dictionary " + path);
+}
+
+Dictionary::Dictionary(const std::string& path) throw(DictionaryError):
+	_map(NULL),
+	_map_size(0)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) throw DictionaryError("unable to open dictionary " + path);
+	struct stat info;
+	if ( fstat(fd, &info) != 0 || info.st_size < off_t(HEADER_WORDS * sizeof(uint64_t)) ) {
+		close(fd);
+		throw DictionaryError("not a symbol dictionary: " + path);
+	}
+	_map_size = info.st_size;
+	_map = mmap(NULL, _map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( _map == MAP_FAILED ) throw DictionaryError("unable to map dictionary " + path);
+
+	const uint64_t* header = static_cast<const uint64_t*>(_map);
+	_slot_count = header[1];
+	_candidate_count = header[2];
+	_pool_size = header[3];
+	const uint64_t words = _map_size / sizeof(uint64_t) - HEADER_WORDS;
+	// check each section fits before computing where the next one starts.
+	if ( header[0] != DICTIONARY_MAGIC || _slot_count == 0 || (_slot_count & (_slot_count - 1)) ||
+		 _slot_count > words / 2 || _candidate_count > 2 * (words - 2 * _slot_count) ||
+		 _pool_size > _map_size - sizeof(uint64_t) * (HEADER_WORDS + 2 * _slot_count) - sizeof(uint32_t) * _candidate_count ) {
+		munmap(_map, _map_size);
+		throw DictionaryError("corrupt symbol dictionary: " + path);
+	}
+	_slots = header + HEADER_WORDS;
+	_candidates = reinterpret_cast<const uint32_t*>(_slots + 2 * _slot_count);
+	_pool = reinterpret_cast<const char*>(_candidates + _candidate_count);
+}
+
+Dictionary::~Dictionary() {
+	munmap(_map, _map_size);
+}
+
+size_t Dictionary::lookup(Symbol symbol, std::vector<std::string>& identifiers) const throw(DictionaryError) {
+	identifiers.clear();
+	if ( !symbol.is_lossy() ) {
+		identifiers.push_back(symbol.decode());
+		return 1;
+	}
+
+	const uint64_t code = symbol.code();
+	uint64_t i = hash(code) & (_slot_count - 1);
+	for ( uint64_t probes = 0; probes < _slot_count; ++probes, i = (i + 1) & (_slot_count - 1) ) {
+		if ( _slots[2 * i] == 0 ) return 0;
+		if ( _slots[2 * i] != code ) continue;
+
+		const uint64_t first = _slots[2 * i + 1] >> 32;
+		const uint64_t count = _slots[2 * i + 1] & 0xffffffff;
+		if ( first > _candidate_count || count > _candidate_count - first ) {
+			throw DictionaryError("corrupt symbol dictionary entry");
+		}
+		for ( uint64_t c = first; c < first + count; ++c ) {
+			const uint32_t offset = _candidates[c];
+			if ( offset >= _pool_size ) throw DictionaryError("corrupt symbol dictionary entry");
+			identifiers.push_back(std::string(_pool + offset, strnlen(_pool + offset, _pool_size - offset)));
+		}
+		return identifiers.size();
+	}
+	return 0;
+}
+
+std::string Dictionary::resolve(Symbol symbol) const throw(DictionaryError) {
+	std::vector<std::string> identifiers;
+	if ( lookup(symbol, identifiers) == 1 ) return identifiers[0];
+	return symbol.decode();
+}
+
+} // end namespace symbol.
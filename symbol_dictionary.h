@@ -0,0 +1,75 @@
+#ifndef SYMBOL_DICTIONARY_H
+#define SYMBOL_DICTIONARY_H
+#include "symbol.h"
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// This error is thrown when a dictionary file can't be written, opened, or is malformed.
+class DictionaryError: public std::runtime_error {
+public:
+	explicit DictionaryError(const std::string& message): std::runtime_error(message) {}
+};
+
+// Collects identifiers from a corpus (source trees, schema files, ...) and
+// writes a reverse dictionary from lossy symbol codes back to the
+// identifiers that produce them.  Exact symbols decode without help, so
+// only identifiers longer than 10 characters are kept.
+class DictionaryBuilder {
+	std::map<uint64_t, std::set<std::string> > _identifiers;
+public:
+	// adds one identifier.  Returns false if it isn't a valid identifier.
+	bool add(const std::string& identifier);
+
+	// adds every identifier in some text, i.e. every maximal run of letters,
+	// digits and underscores.  Returns the number of lossy identifiers found.
+	size_t add_text(const std::string& text);
+
+	// number of distinct lossy codes collected so far.
+	size_t size() const { return _identifiers.size(); }
+
+	// Writes the dictionary file.  It's a header, an open-addressing hash
+	// table of codes, the candidate identifiers of each code, and a pool of
+	// null-terminated strings, all laid out to be used in place via mmap.
+	void write(const std::string& path) const throw(DictionaryError);
+};
+
+// A dictionary file opened read-only with mmap.  Nothing is loaded up
+// front; each lookup is one hash probe sequence plus the candidate strings.
+class Dictionary {
+	void* _map;
+	size_t _map_size;
+	const uint64_t* _slots;
+	uint64_t _slot_count;
+	const uint32_t* _candidates;
+	uint64_t _candidate_count;
+	const char* _pool;
+	uint64_t _pool_size;
+
+	// ~Dictionary unmaps the file; open it again for a second Dictionary.
+	Dictionary(const Dictionary&);
+	Dictionary& operator=(const Dictionary&);
+
+public:
+	explicit Dictionary(const std::string& path) throw(DictionaryError);
+	~Dictionary();
+
+	// Replaces identifiers with every identifier that encodes to the
+	// symbol, and returns how many there are.  Exact symbols always have
+	// exactly one, their decoding.  Lossy symbols have none if they didn't
+	// occur in the corpus, and more than one if their codes collide.
+	size_t lookup(Symbol symbol, std::vector<std::string>& identifiers) const throw(DictionaryError);
+
+	// the identifier if there's exactly one candidate, otherwise the symbol's
+	// (lossy) decoding.
+	std::string resolve(Symbol symbol) const throw(DictionaryError);
+};
+
+}
+#endif
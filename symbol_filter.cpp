@@ -0,0 +1,75 @@
+#include "symbol_filter.h"
+#include <algorithm>
+  // provides fill
+#ifdef SYMBOL_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace symbol {
+
+const uint32_t SymbolFilter::SALT[8] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+// contains_many() hashes and prefetches this many keys before testing them.
+static const size_t BATCH = 64;
+
+SymbolFilter::SymbolFilter(size_t expected_keys, size_t bits_per_key):
+	_blocks(NULL),
+	_block_count((expected_keys * bits_per_key + 255) / 256)
+{
+	if ( _block_count == 0 ) _block_count = 1;
+	// one spare block's worth of words so the blocks can start 32-byte aligned.
+	_storage.resize(8 * (_block_count + 1), 0);
+	uintptr_t start = reinterpret_cast<uintptr_t>(&_storage[0]);
+	_blocks = reinterpret_cast<uint32_t*>((start + 31) & ~uintptr_t(31));
+}
+
+#ifdef SYMBOL_AVX2_DISPATCH
+// tests each hash's block, computing all eight masks at once:
+// 1 << ((h * SALT[i]) >> 27)
+SYMBOL_TARGET_AVX2 static void test_blocks_avx2(const uint64_t* hashes, uint32_t* const* blocks,
+	size_t count, const uint32_t* salts, bool* out)
+{
+	const __m256i salt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(salts));
+	for ( size_t i = 0; i < count; ++i ) {
+		__m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(uint32_t(hashes[i])), salt), 27);
+		__m256i masks = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+		__m256i bits = _mm256_load_si256(reinterpret_cast<const __m256i*>(blocks[i]));
+		// true if every mask bit is set in the block
+		out[i] = _mm256_testc_si256(bits, masks);
+	}
+}
+#endif
+
+void SymbolFilter::contains_many(const Symbol* keys, size_t n, bool* out) const throw() {
+	uint64_t hashes[BATCH];
+	uint32_t* blocks[BATCH];
+	for ( size_t first = 0; first < n; first += BATCH ) {
+		const size_t count = std::min(BATCH, n - first);
+		// start every block load of the batch before waiting on any of them.
+		for ( size_t i = 0; i < count; ++i ) {
+			hashes[i] = hash(keys[first + i]);
+			blocks[i] = block(hashes[i]);
+			SYMBOL_PREFETCH(blocks[i]);
+		}
+#ifdef SYMBOL_AVX2_DISPATCH
+		if ( avx2_enabled() ) {
+			test_blocks_avx2(hashes, blocks, count, SALT, out + first);
+			continue;
+		}
+#endif
+		for ( size_t i = 0; i < count; ++i ) {
+			bool present = true;
+			for ( unsigned j = 0; j < 8; ++j ) present &= (blocks[i][j] & mask(hashes[i], j)) != 0;
+			out[first + i] = present;
+		}
+	}
+}
+
+void SymbolFilter::clear() throw() {
+	std::fill(_storage.begin(), _storage.end(), 0);
+}
+
+} // end namespace symbol.
@@ -0,0 +1,74 @@
+#ifndef SYMBOL_FILTER_H
+#define SYMBOL_FILTER_H
+#include "symbol.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// A blocked Bloom filter of symbols, for skipping lookups that are sure to
+// miss.  contains() never returns false for an inserted symbol, and returns
+// true for a symbol that was never inserted with a small probability (about
+// 1% at the default 12 bits per key).
+//
+// Each symbol maps to one 32-byte block, aligned so it never straddles a
+// cache line, and sets one bit in each of the block's eight 32-bit words.
+// So a query touches a single cache line, and with AVX2 it's a handful of
+// vector instructions.  Symbols can't be removed, but a filter may always
+// hold more symbols than it should; that only raises the false positive rate.
+class SymbolFilter {
+	std::vector<uint32_t> _storage;
+	uint32_t* _blocks;
+	uint64_t _block_count;
+
+	// odd multipliers that pick a different bit of each word from one hash.
+	static const uint32_t SALT[8];
+
+	// not copyable: _blocks points into _storage.
+	SymbolFilter(const SymbolFilter&);
+	SymbolFilter& operator=(const SymbolFilter&);
+
+	// the first word of the block for a hash: the high 32 bits scaled to the block count.
+	uint32_t* block(uint64_t h) const throw() {
+		return _blocks + 8 * (((h >> 32) * _block_count) >> 32);
+	}
+
+	// the bit in word i of the block, from the low 32 bits of the hash.
+	static uint32_t mask(uint64_t h, unsigned i) throw() {
+		return uint32_t(1) << ((uint32_t(h) * SALT[i]) >> 27);
+	}
+
+public:
+	// sized for the expected number of symbols at the given number of bits each.
+	explicit SymbolFilter(size_t expected_keys, size_t bits_per_key = 12);
+
+	void insert(Symbol key) throw() {
+		const uint64_t h = hash(key);
+		uint32_t* words = block(h);
+		for ( unsigned i = 0; i < 8; ++i ) words[i] |= mask(h, i);
+	}
+
+	// false if key was definitely never inserted.
+	bool contains(Symbol key) const throw() {
+		const uint64_t h = hash(key);
+		const uint32_t* words = block(h);
+		for ( unsigned i = 0; i < 8; ++i ) {
+			if ( (words[i] & mask(h, i)) == 0 ) return false;
+		}
+		return true;
+	}
+
+	// contains() for n keys at once, storing the answers in out.  Blocks are
+	// prefetched ahead of the keys being tested, and tested with AVX2 when
+	// the processor has it.
+	void contains_many(const Symbol* keys, size_t n, bool* out) const throw();
+
+	// removes every symbol.
+	void clear() throw();
+
+	size_t size_in_bytes() const throw() { return _block_count * 32; }
+};
+
+}
+#endif
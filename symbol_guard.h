@@ -0,0 +1,18 @@
+#ifndef SYMBOL_GUARD_H
+#define SYMBOL_GUARD_H
+#include <pthread.h>
+
+namespace symbol {
+
+// locks a mutex for the lifetime of the guard.  Internal to the library.
+class Guard {
+	pthread_mutex_t& _mutex;
+	Guard(const Guard&);
+	Guard& operator=(const Guard&);
+public:
+	explicit Guard(pthread_mutex_t& mutex): _mutex(mutex) { pthread_mutex_lock(&_mutex); }
+	~Guard() { pthread_mutex_unlock(&_mutex); }
+};
+
+}
+#endif
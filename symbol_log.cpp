@@ -0,0 +1,298 @@
+#include "symbol_log.h"
+#include "symbol_guard.h"
+  // provides Guard
+#include "symbol_dictionary.h"
+#include <istream>
+#include <new>
+  // provides bad_alloc
+#include <ostream>
+#include <vector>
+#include <string.h>
+  // provides strlen
+#include <unistd.h>
+  // provides write
+
+namespace symbol {
+
+// "SYMLOG01" in ASCII; the first word of every dump.
+static const uint64_t LOG_MAGIC = 0x3130474f4c4d5953UL;
+
+// an entry is a header word, (site << 32) | argc, and then the arguments.
+static const unsigned MAX_ARGS = 4;
+
+// A single-producer, single-consumer ring of words.  head and tail count
+// words ever written and read, and are kept on separate cache lines so the
+// writer and the reader don't invalidate each other's line on every entry.
+class SymbolLog::Ring {
+public:
+	uint64_t head;
+	char head_padding[56];
+	uint64_t tail;
+	char tail_padding[56];
+	// the writer's last view of tail, so it only reads tail when it seems full.
+	uint64_t known_tail;
+	std::vector<uint64_t> words;
+	uint64_t mask;
+	// nonzero while a thread holds the ring as its writer.
+	unsigned held;
+
+	Ring(size_t size, unsigned held): head(0), tail(0), known_tail(0), words(size), mask(size - 1), held(held) {}
+};
+
+SymbolLog::SymbolLog(size_t ring_words, size_t max_threads, size_t max_sites):
+	_rings(new Ring*[max_threads]),
+	_max_threads(max_threads),
+	_ring_words(8),
+	_sites(new const char*[max_sites]),
+	_max_sites(max_sites),
+	_site_count(0),
+	_dropped(0)
+{
+	// without a key no thread could find its ring, and every entry would be dropped.
+	if ( pthread_key_create(&_key, release_ring) != 0 ) {
+		delete[] _rings;
+		delete[] _sites;
+		throw LogError("no thread-specific key left for the log");
+	}
+	while ( _ring_words < ring_words ) _ring_words *= 2;
+	for ( size_t i = 0; i < _max_threads; ++i ) _rings[i] = NULL;
+	pthread_mutex_init(&_site_mutex, NULL);
+	pthread_mutex_init(&_drain_mutex, NULL);
+}
+
+SymbolLog::~SymbolLog() {
+	pthread_key_delete(_key);
+	for ( size_t i = 0; i < _max_threads; ++i ) delete _rings[i];
+	delete[] _rings;
+	delete[] _sites;
+	pthread_mutex_destroy(&_site_mutex);
+	pthread_mutex_destroy(&_drain_mutex);
+}
+
+uint32_t SymbolLog::site(const char* format) throw(LogError) {
+	Guard guard(_site_mutex);
+	if ( _site_count == _max_sites ) throw LogError("too many log sites");
+	_sites[_site_count] = format;
+	// publish the format before the count that makes it visible to dump().
+	__atomic_store_n(&_site_count, _site_count + 1, __ATOMIC_RELEASE);
+	return _site_count - 1;
+}
+
+void SymbolLog::release_ring(void* ring) {
+	// publish the last entries before another thread may take the ring.
+	__atomic_store_n(&static_cast<Ring*>(ring)->held, 0, __ATOMIC_RELEASE);
+}
+
+SymbolLog::Ring* SymbolLog::local_ring() {
+	Ring* ring = static_cast<Ring*>(pthread_getspecific(_key));
+	if ( ring ) return ring;
+
+	// take the first ring nobody holds, or create one in the first empty slot.
+	for ( size_t i = 0; i < _max_threads; ++i ) {
+		ring = __atomic_load_n(&_rings[i], __ATOMIC_ACQUIRE);
+		if ( ring == NULL ) {
+			// write() can't throw, so a ring that can't be allocated drops the entry.
+			Ring* created = NULL;
+			try {
+				created = new Ring(_ring_words, 1);
+			} catch ( std::bad_alloc& e ) {
+				return NULL;
+			}
+			if ( __atomic_compare_exchange_n(&_rings[i], &ring, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ) {
+				ring = created;
+				break;
+			}
+			// another thread filled the slot first, but may have released it since.
+			delete created;
+		}
+		unsigned released = 0;
+		if ( __atomic_compare_exchange_n(&ring->held, &released, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) break;
+		ring = NULL;
+	}
+	if ( ring && pthread_setspecific(_key, ring) != 0 ) {
+		release_ring(ring);
+		ring = NULL;
+	}
+	return ring;
+}
+
+void SymbolLog::reserve(size_t rings) {
+	for ( size_t i = 0; i < rings && i < _max_threads; ++i ) {
+		if ( __atomic_load_n(&_rings[i], __ATOMIC_ACQUIRE) != NULL ) continue;
+		Ring* created = new Ring(_ring_words, 0);
+		Ring* empty = NULL;
+		if ( !__atomic_compare_exchange_n(&_rings[i], &empty, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ) delete created;
+	}
+}
+
+void SymbolLog::write(uint32_t site, const uint64_t* args, unsigned argc) throw() {
+	Ring* ring = local_ring();
+	if ( ring == NULL ) {
+		__atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	const uint64_t head = ring->head;
+	const uint64_t end = head + 1 + argc;
+	if ( end - ring->known_tail > _ring_words ) {
+		ring->known_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if ( end - ring->known_tail > _ring_words ) {
+			__atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+	ring->words[head & ring->mask] = (uint64_t(site) << 32) | argc;
+	for ( unsigned i = 0; i < argc; ++i ) ring->words[(head + 1 + i) & ring->mask] = args[i];
+	// publish the words before the head that makes them visible to readers.
+	__atomic_store_n(&ring->head, end, __ATOMIC_RELEASE);
+}
+
+// writes one entry's format with each {} replaced by the next argument.
+// Arguments without a {} are appended.
+static void format_entry(const char* format, const uint64_t* args, unsigned argc,
+	const Dictionary* dictionary, std::ostream& out)
+{
+	unsigned next = 0;
+	const char* p = format;
+	for ( ; *p; ++p ) {
+		if ( p[0] == '{' && p[1] == '}' && next < argc ) {
+			out << (dictionary ? dictionary->resolve(args[next]) : decode(args[next]));
+			++next;
+			++p;
+		} else {
+			out << *p;
+		}
+	}
+	for ( ; next < argc; ++next ) {
+		out << ' ' << (dictionary ? dictionary->resolve(args[next]) : decode(args[next]));
+	}
+	out << '\n';
+}
+
+size_t SymbolLog::drain(std::ostream& out) {
+	Guard guard(_drain_mutex);
+	const size_t site_count = __atomic_load_n(&_site_count, __ATOMIC_ACQUIRE);
+	size_t entries = 0;
+	for ( size_t r = 0; r < _max_threads; ++r ) {
+		Ring* ring = __atomic_load_n(&_rings[r], __ATOMIC_ACQUIRE);
+		if ( ring == NULL ) continue;
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = ring->tail;
+		while ( tail < head ) {
+			const uint64_t header = ring->words[tail & ring->mask];
+			const uint32_t site = header >> 32;
+			const unsigned argc = header & 0xffffffff;
+			uint64_t args[MAX_ARGS];
+			for ( unsigned i = 0; i < argc; ++i ) args[i] = ring->words[(tail + 1 + i) & ring->mask];
+			// log() only takes registered sites, but nothing stops a bad number.
+			format_entry(site < site_count ? _sites[site] : "(unknown site)", args, argc, NULL, out);
+			tail += 1 + argc;
+			++entries;
+		}
+		// hand the words back to the writer only after they're read.
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	return entries;
+}
+
+// writes all of a buffer to a file descriptor, retrying partial writes.
+static bool write_all(int fd, const void* data, size_t size) throw() {
+	const char* p = static_cast<const char*>(data);
+	while ( size > 0 ) {
+		const ssize_t written = ::write(fd, p, size);
+		if ( written <= 0 ) return false;
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool write_word(int fd, uint64_t word) throw() {
+	return write_all(fd, &word, sizeof(word));
+}
+
+bool SymbolLog::dump(int fd) const throw() {
+	// the sites: a count, then each format's length and bytes, padded to 8.
+	const size_t site_count = __atomic_load_n(&_site_count, __ATOMIC_ACQUIRE);
+	bool ok = write_word(fd, LOG_MAGIC) && write_word(fd, site_count);
+	const char padding[8] = { 0 };
+	for ( size_t i = 0; ok && i < site_count; ++i ) {
+		const size_t length = strlen(_sites[i]);
+		ok = write_word(fd, length) && write_all(fd, _sites[i], length) &&
+			write_all(fd, padding, (8 - length % 8) % 8);
+	}
+
+	// then each ring's entries: a word count, then the words, unwrapped.
+	for ( size_t r = 0; ok && r < _max_threads; ++r ) {
+		const Ring* ring = __atomic_load_n(&_rings[r], __ATOMIC_ACQUIRE);
+		if ( ring == NULL ) continue;
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		const uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if ( head == tail ) continue;
+		ok = write_word(fd, head - tail);
+		const uint64_t first = tail & ring->mask;
+		const uint64_t last = head & ring->mask;
+		if ( ok && first < last ) {
+			ok = write_all(fd, &ring->words[first], (last - first) * sizeof(uint64_t));
+		} else if ( ok ) {
+			ok = write_all(fd, &ring->words[first], (ring->words.size() - first) * sizeof(uint64_t)) &&
+				write_all(fd, &ring->words[0], last * sizeof(uint64_t));
+		}
+	}
+	return ok;
+}
+
+// reads one word of a dump; false at the end of the stream.
+static bool read_word(std::istream& in, uint64_t& word) {
+	in.read(reinterpret_cast<char*>(&word), sizeof(word));
+	if ( in.gcount() == 0 ) return false;
+	if ( in.gcount() != sizeof(word) ) throw LogError("truncated symbol log");
+	return true;
+}
+
+static uint64_t expect_word(std::istream& in) {
+	uint64_t word;
+	if ( !read_word(in, word) ) throw LogError("truncated symbol log");
+	return word;
+}
+
+size_t format_log(std::istream& in, std::ostream& out, const Dictionary* dictionary) throw(LogError) {
+	uint64_t magic;
+	if ( !read_word(in, magic) || magic != LOG_MAGIC ) throw LogError("not a symbol log");
+
+	// formats are arbitrary text; bound them only by what a sane dump holds.
+	const uint64_t site_count = expect_word(in);
+	if ( site_count > 0xffffffffUL ) throw LogError("corrupt symbol log");
+	std::vector<std::string> sites;
+	for ( uint64_t i = 0; i < site_count; ++i ) {
+		const uint64_t length = expect_word(in);
+		if ( length > (1 << 20) ) throw LogError("corrupt symbol log");
+		std::string format((length + 7) / 8 * 8, '\0');
+		in.read(&format[0], format.size());
+		if ( in.gcount() != std::streamsize(format.size()) ) throw LogError("truncated symbol log");
+		format.resize(length);
+		sites.push_back(format);
+	}
+
+	size_t entries = 0;
+	uint64_t words;
+	while ( read_word(in, words) ) {
+		while ( words > 0 ) {
+			const uint64_t header = expect_word(in);
+			const uint64_t site = header >> 32;
+			const uint64_t argc = header & 0xffffffff;
+			if ( argc > MAX_ARGS || argc >= words ) throw LogError("corrupt symbol log entry");
+			uint64_t args[MAX_ARGS];
+			for ( unsigned i = 0; i < argc; ++i ) args[i] = expect_word(in);
+			try {
+				format_entry(site < sites.size() ? sites[site].c_str() : "(unknown site)", args, argc, dictionary, out);
+			} catch ( DictionaryError& e ) {
+				throw LogError(e.what());
+			}
+			words -= 1 + argc;
+			++entries;
+		}
+	}
+	return entries;
+}
+
+} // end namespace symbol.
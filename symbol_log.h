@@ -0,0 +1,138 @@
+#ifndef SYMBOL_LOG_H
+#define SYMBOL_LOG_H
+#include "symbol.h"
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+class Dictionary;
+
+// This error is thrown when a log can't register a site, or a log dump is malformed.
+class LogError: public std::runtime_error {
+public:
+	explicit LogError(const std::string& message): std::runtime_error(message) {}
+};
+
+// A log sink that defers all string work until the log is read.
+//
+// Each log statement is registered once as a site, a format string with a
+// {} for each symbol argument.  Logging an entry then stores the site
+// number and the raw symbol codes in the calling thread's ring buffer: a
+// few stores and one release, with no locks, allocation or decoding.
+// The exception is a thread's first entry, which allocates its ring unless
+// reserve() made one beforehand; if that allocation fails, the entry is
+// dropped.
+//
+//     static const uint32_t LOOKUP = log.site("looked up {} in {}");
+//     log.log(LOOKUP, key, space_name);
+//
+// drain() decodes and formats the buffered entries in-process.  dump()
+// writes them raw, with the site formats, for format_log() to decode
+// later, e.g. from a crash handler.  Entries come out in order for each
+// thread, one thread after another.
+//
+// Each ring has a single writer (its thread) and a single reader (drain,
+// which is serialized), so the rings need no locks.  When a thread's ring
+// is full, its new entries are dropped and counted instead of waiting.
+class SymbolLog {
+	class Ring;
+
+	// rings are created on demand, and each is held by at most one live
+	// thread, found through _key.  A thread's ring is freed for reuse by
+	// another thread when it exits.
+	Ring** _rings;
+	size_t _max_threads;
+	size_t _ring_words;
+	pthread_key_t _key;
+
+	// site formats, by site number.  Formats aren't copied.
+	const char** _sites;
+	size_t _max_sites;
+	size_t _site_count;
+	pthread_mutex_t _site_mutex;
+
+	// serializes readers of the rings.
+	pthread_mutex_t _drain_mutex;
+	uint64_t _dropped;
+
+	// the calling thread's ring, or NULL if every ring is held by another thread.
+	Ring* local_ring();
+
+	// the _key destructor: frees an exiting thread's ring.
+	static void release_ring(void* ring);
+
+	void write(uint32_t site, const uint64_t* args, unsigned argc) throw();
+
+	// threads find their rings through _key, and a copy couldn't take them over.
+	SymbolLog(const SymbolLog&);
+	SymbolLog& operator=(const SymbolLog&);
+
+public:
+	// ring_words is each thread's buffer size in 8-byte words (rounded up to
+	// a power of two); an entry takes one word plus one per argument.
+	// max_threads is the number of threads that may hold a ring at once.
+	// A thread holds its ring until it exits, and then the ring, with any
+	// entries not yet drained, passes to the next thread that logs.
+	// Each log uses one of the process's PTHREAD_KEYS_MAX thread-specific
+	// keys (1024 with glibc) for as long as it exists, and throws LogError
+	// if none is left.
+	explicit SymbolLog(size_t ring_words = 1 << 16, size_t max_threads = 64, size_t max_sites = 4096);
+	~SymbolLog();
+
+	// creates rings ahead of time until there are at least rings of them
+	// (at most max_threads), so the first entries of that many threads
+	// don't allocate.  Throws std::bad_alloc if a ring can't be allocated.
+	void reserve(size_t rings);
+
+	// registers a log statement and returns its site number.  format must
+	// outlive the log, e.g. be a string literal.
+	uint32_t site(const char* format) throw(LogError);
+
+	void log(uint32_t site) throw() {
+		write(site, NULL, 0);
+	}
+	void log(uint32_t site, Symbol a) throw() {
+		const uint64_t args[1] = { a.code() };
+		write(site, args, 1);
+	}
+	void log(uint32_t site, Symbol a, Symbol b) throw() {
+		const uint64_t args[2] = { a.code(), b.code() };
+		write(site, args, 2);
+	}
+	void log(uint32_t site, Symbol a, Symbol b, Symbol c) throw() {
+		const uint64_t args[3] = { a.code(), b.code(), c.code() };
+		write(site, args, 3);
+	}
+	void log(uint32_t site, Symbol a, Symbol b, Symbol c, Symbol d) throw() {
+		const uint64_t args[4] = { a.code(), b.code(), c.code(), d.code() };
+		write(site, args, 4);
+	}
+
+	// removes every buffered entry and writes it to out, formatted, one per
+	// line.  Returns the number of entries.
+	size_t drain(std::ostream& out);
+
+	// Writes the site formats and every buffered entry to a file
+	// descriptor, in binary, without removing them.  It only reads memory
+	// and calls write(), so it's safe in a signal handler, but not while
+	// another thread drains.  Returns false if a write failed.
+	bool dump(int fd) const throw();
+
+	// number of entries dropped because a ring was full, because
+	// max_threads live threads already held every ring, or because a new
+	// ring couldn't be allocated.
+	uint64_t dropped() const throw() { return __atomic_load_n(&_dropped, __ATOMIC_RELAXED); }
+};
+
+// Formats the entries of a dump() to out, one per line, and returns the
+// number of entries.  Lossy symbols are resolved with the dictionary if
+// one is given.
+size_t format_log(std::istream& in, std::ostream& out, const Dictionary* dictionary = NULL) throw(LogError);
+
+}
+#endif
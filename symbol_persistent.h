@@ -0,0 +1,309 @@
+#ifndef SYMBOL_PERSISTENT_H
+#define SYMBOL_PERSISTENT_H
+#include "symbol.h"
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// An immutable map keyed by Symbol.  set() and del() return a new version
+// and leave the original untouched, but the two share every node the
+// update didn't touch, so an update allocates only the nodes on one path
+// through the trie, and copying a PersistentSpace is O(1).  That makes it
+// suitable for namespaces that need snapshotting, e.g. for closures or
+// transactions.
+//
+// It's a hash array mapped trie: each level is indexed by the next 6 bits
+// of symbol::hash(key), and each node stores its keys and subtries in
+// dense arrays selected by two 64-bit bitmaps.  Nodes are reference
+// counted (atomically, so versions may be shared between threads).
+//
+// For bulk builds, a Transient applies updates in place to nodes that no
+// other version can see, and hands out a persistent snapshot when done.
+template<typename Value>
+class PersistentSpace {
+    typedef std::pair<Symbol, Value> Entry;
+
+    class Node {
+    public:
+        unsigned refs;
+        // slots holding a key directly, and slots holding a subtrie.
+        uint64_t datamap;
+        uint64_t nodemap;
+        std::vector<Entry> entries;
+        std::vector<Node*> children;
+        Node(): refs(1), datamap(0), nodemap(0) {}
+    };
+
+    static void retain(Node* node) {
+        if ( node ) __atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    static void release(Node* node) {
+        if ( node && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0 ) {
+            for ( size_t i = 0; i < node->children.size(); ++i ) release(node->children[i]);
+            delete node;
+        }
+    }
+
+    // the bitmap bit for a hash at the level starting at shift.
+    static uint64_t slot_bit(uint64_t h, unsigned shift) {
+        return uint64_t(1) << ((h >> shift) & 63);
+    }
+
+    // the position of a slot's item in a node's dense array.
+    static size_t slot_index(uint64_t bitmap, uint64_t bit) {
+        return __builtin_popcountll(bitmap & (bit - 1));
+    }
+
+    // returns a node the caller may modify: the node itself if the caller
+    // has the only path to it, otherwise a copy.  Either way the caller
+    // owns the result.
+    static Node* edit(Node* node, bool unique) {
+        if ( unique ) return node;
+        Node* copy = new Node();
+        copy->datamap = node->datamap;
+        copy->nodemap = node->nodemap;
+        copy->entries = node->entries;
+        copy->children = node->children;
+        for ( size_t i = 0; i < copy->children.size(); ++i ) retain(copy->children[i]);
+        return copy;
+    }
+
+    // a new subtrie holding two keys whose hashes agree below shift.
+    static Node* pair_node(const Entry& a, const Entry& b, unsigned shift) {
+        Node* node = new Node();
+        const uint64_t a_bit = slot_bit(hash(a.first), shift);
+        const uint64_t b_bit = slot_bit(hash(b.first), shift);
+        if ( a_bit == b_bit ) {
+            // hashes are unique, so they differ somewhere further down.
+            node->nodemap = a_bit;
+            node->children.push_back(pair_node(a, b, shift + 6));
+        } else {
+            node->datamap = a_bit | b_bit;
+            node->entries.push_back(a_bit < b_bit ? a : b);
+            node->entries.push_back(a_bit < b_bit ? b : a);
+        }
+        return node;
+    }
+
+    // Returns node with key set to value, as a node the caller owns.  If
+    // unique, nothing else can reach node and it may be changed in place.
+    static Node* assoc(Node* node, const Entry& entry, uint64_t h, unsigned shift, bool unique, bool& added) {
+        if ( node == NULL ) {
+            node = new Node();
+            node->datamap = slot_bit(h, shift);
+            node->entries.push_back(entry);
+            added = true;
+            return node;
+        }
+        // other threads may drop references concurrently; the acquire pairs
+        // with their release so they're done reading node before we change it.
+        unique = unique && __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1;
+        const uint64_t bit = slot_bit(h, shift);
+
+        if ( node->datamap & bit ) {
+            const size_t i = slot_index(node->datamap, bit);
+            Node* result = edit(node, unique);
+            if ( result->entries[i].first == entry.first ) {
+                // replace the value
+                result->entries[i].second = entry.second;
+                return result;
+            }
+            // two keys in one slot: push both down a level.
+            Node* child = pair_node(result->entries[i], entry, shift + 6);
+            result->entries.erase(result->entries.begin() + i);
+            result->datamap ^= bit;
+            result->children.insert(result->children.begin() + slot_index(result->nodemap, bit), child);
+            result->nodemap |= bit;
+            added = true;
+            return result;
+        }
+
+        if ( node->nodemap & bit ) {
+            const size_t j = slot_index(node->nodemap, bit);
+            Node* child = assoc(node->children[j], entry, h, shift + 6, unique, added);
+            Node* result = edit(node, unique);
+            if ( result->children[j] != child ) {
+                release(result->children[j]);
+                result->children[j] = child;
+            }
+            return result;
+        }
+
+        Node* result = edit(node, unique);
+        result->entries.insert(result->entries.begin() + slot_index(result->datamap, bit), entry);
+        result->datamap |= bit;
+        added = true;
+        return result;
+    }
+
+    // Returns node without key, as a node the caller owns, or NULL if that
+    // leaves it empty.  If the key isn't there, returns node itself, sets
+    // removed to false and takes no ownership.
+    static Node* dissoc(Node* node, Symbol key, uint64_t h, unsigned shift, bool unique, bool& removed) {
+        removed = false;
+        if ( node == NULL ) return NULL;
+        unique = unique && __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1;
+        const uint64_t bit = slot_bit(h, shift);
+
+        if ( node->datamap & bit ) {
+            const size_t i = slot_index(node->datamap, bit);
+            if ( node->entries[i].first != key ) return node;
+            removed = true;
+            if ( node->entries.size() == 1 && node->nodemap == 0 ) {
+                // the caller releases its reference to node.
+                return NULL;
+            }
+            Node* result = edit(node, unique);
+            result->entries.erase(result->entries.begin() + i);
+            result->datamap ^= bit;
+            return result;
+        }
+
+        if ( node->nodemap & bit ) {
+            const size_t j = slot_index(node->nodemap, bit);
+            Node* child = dissoc(node->children[j], key, h, shift + 6, unique, removed);
+            if ( !removed ) return node;
+            Node* result = edit(node, unique);
+            Node* old = result->children[j];
+            if ( child == NULL ) {
+                result->children.erase(result->children.begin() + j);
+                result->nodemap ^= bit;
+                release(old);
+            } else if ( child->nodemap == 0 && child->entries.size() == 1 ) {
+                // a subtrie with one key left: pull the key up into this node.
+                result->children.erase(result->children.begin() + j);
+                result->nodemap ^= bit;
+                result->entries.insert(result->entries.begin() + slot_index(result->datamap, bit), child->entries[0]);
+                result->datamap |= bit;
+                if ( child != old ) release(child);
+                release(old);
+            } else if ( child != old ) {
+                release(old);
+                result->children[j] = child;
+            }
+            if ( result->datamap == 0 && result->nodemap == 0 ) {
+                if ( result != node ) release(result);
+                return NULL;
+            }
+            return result;
+        }
+
+        return node;
+    }
+
+    static const Value* lookup(Node* node, Symbol key) {
+        const uint64_t h = hash(key);
+        for ( unsigned shift = 0; node != NULL; shift += 6 ) {
+            const uint64_t bit = slot_bit(h, shift);
+            if ( node->datamap & bit ) {
+                const Entry& entry = node->entries[slot_index(node->datamap, bit)];
+                return entry.first == key ? &entry.second : NULL;
+            } else if ( node->nodemap & bit ) {
+                node = node->children[slot_index(node->nodemap, bit)];
+            } else {
+                return NULL;
+            }
+        }
+        return NULL;
+    }
+
+    Node* root;
+    size_t _size;
+
+    // adopts a root the caller owns.
+    PersistentSpace(Node* r, size_t size): root(r), _size(size) {}
+
+public:
+    // New, empty space
+    PersistentSpace(): root(NULL), _size(0) {}
+
+    // copies share everything, so they're O(1) snapshots.
+    PersistentSpace(const PersistentSpace& other): root(other.root), _size(other._size) {
+        retain(root);
+    }
+    PersistentSpace& operator=(const PersistentSpace& other) {
+        retain(other.root);
+        release(root);
+        root = other.root;
+        _size = other._size;
+        return *this;
+    }
+    ~PersistentSpace() { release(root); }
+
+    size_t size() const { return _size; }
+
+    // returns a pointer to the Value, or NULL if it
+    // isn't found in the space.
+    const Value* get(Symbol key) const { return lookup(root, key); }
+
+    // returns a new version with key set to value.
+    PersistentSpace set(Symbol key, const Value& value) const {
+        bool added = false;
+        Node* r = assoc(root, Entry(key, value), hash(key), 0, false, added);
+        return PersistentSpace(r, _size + (added ? 1 : 0));
+    }
+
+    // returns a new version without key.
+    PersistentSpace del(Symbol key) const {
+        bool removed = false;
+        Node* r = dissoc(root, key, hash(key), 0, false, removed);
+        if ( !removed ) return *this;
+        return PersistentSpace(r, _size - 1);
+    }
+
+    // A mutable builder for batches of updates.  Nodes created by the
+    // transient are changed in place by later updates, so a bulk build
+    // allocates each node once instead of once per update.  Nodes shared
+    // with any PersistentSpace are copied before they're changed, so
+    // existing versions are never affected.
+    class Transient {
+        Node* root;
+        size_t _size;
+
+        // not copyable: two transients must never share a node they may change.
+        Transient(const Transient&);
+        Transient& operator=(const Transient&);
+
+    public:
+        explicit Transient(const PersistentSpace& from = PersistentSpace()): root(from.root), _size(from._size) {
+            retain(root);
+        }
+        ~Transient() { release(root); }
+
+        size_t size() const { return _size; }
+
+        const Value* get(Symbol key) const { return lookup(root, key); }
+
+        void set(Symbol key, const Value& value) {
+            bool added = false;
+            Node* r = assoc(root, Entry(key, value), hash(key), 0, true, added);
+            if ( r != root ) release(root);
+            root = r;
+            if ( added ) ++_size;
+        }
+
+        void del(Symbol key) {
+            bool removed = false;
+            Node* r = dissoc(root, key, hash(key), 0, true, removed);
+            if ( !removed ) return;
+            if ( r != root ) release(root);
+            root = r;
+            --_size;
+        }
+
+        // a snapshot of the current contents.  Later updates to the
+        // transient copy whatever they touch, leaving the snapshot intact.
+        PersistentSpace persistent() const {
+            retain(root);
+            return PersistentSpace(root, _size);
+        }
+    };
+};
+
+}
+
+#endif
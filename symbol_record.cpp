@@ -0,0 +1,233 @@
+#include "symbol_record.h"
+#include <algorithm>
+  // provides sort
+#include <string.h>
+  // provides memcpy, memmove, memset
+
+namespace symbol {
+
+// "SYMR" in ASCII.
+static const uint32_t RECORD_MAGIC = 0x524d5953;
+
+// magic, field count, total size.
+static const size_t HEADER_SIZE = 16;
+
+// each field has an 8-byte name and an 8-byte descriptor.
+static const size_t FIELD_SIZE = 16;
+
+// lengths are stored in 28 bits and offsets in 32.
+static const size_t MAX_LENGTH = (1 << 28) - 1;
+static const size_t MAX_OFFSET = 0xffffffffUL;
+
+// below this many fields, scanning them all beats binary search.
+static const size_t LINEAR_SEARCH = 16;
+
+static size_t align8(size_t n) {
+	return (n + 7) & ~size_t(7);
+}
+
+// record buffers needn't be aligned, so all reads and writes go through memcpy.
+static uint64_t load64(const unsigned char* p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t load32(const unsigned char* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void store64(unsigned char* p, uint64_t value) {
+	memcpy(p, &value, sizeof(value));
+}
+
+static void store32(unsigned char* p, uint32_t value) {
+	memcpy(p, &value, sizeof(value));
+}
+
+Record::Record(const void* data, size_t size) throw(RecordError):
+	_data(static_cast<const unsigned char*>(data)),
+	_size(size),
+	_count(0)
+{
+	if ( size < HEADER_SIZE || load32(_data) != RECORD_MAGIC ) {
+		throw RecordError("not a symbol record");
+	}
+	_count = load32(_data + 4);
+	const uint64_t total = load64(_data + 8);
+	if ( total > size || total < HEADER_SIZE || _count > (total - HEADER_SIZE) / FIELD_SIZE ) {
+		throw RecordError("truncated symbol record");
+	}
+	// trailing bytes after the record aren't part of it.
+	_size = total;
+}
+
+long Record::find(Symbol key) const throw() {
+	const uint64_t code = key.code();
+	const unsigned char* keys = _data + HEADER_SIZE;
+
+	// binary search down to a short run of names...
+	size_t base = 0;
+	size_t n = _count;
+	while ( n > LINEAR_SEARCH ) {
+		const size_t half = n / 2;
+		if ( load64(keys + 8 * (base + half)) < code ) {
+			base += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	// ...then count the smaller names in it without branching, which the
+	// compiler can vectorize.
+	size_t smaller = 0;
+	for ( size_t i = 0; i < n; ++i ) {
+		smaller += load64(keys + 8 * (base + i)) < code;
+	}
+	const size_t index = base + smaller;
+	if ( index < _count && load64(keys + 8 * index) == code ) return index;
+	return -1;
+}
+
+Symbol Record::key(size_t index) const throw(RecordError) {
+	if ( index >= _count ) throw RecordError("record field index out of range");
+	return load64(_data + HEADER_SIZE + 8 * index);
+}
+
+FieldType Record::type(Symbol key) const throw() {
+	const long index = find(key);
+	if ( index < 0 ) return FIELD_NONE;
+	const uint64_t descriptor = load64(_data + HEADER_SIZE + 8 * (_count + index));
+	return FieldType(descriptor & 0xf);
+}
+
+const unsigned char* Record::value(Symbol key, FieldType type, size_t& length) const throw(RecordError) {
+	const long index = find(key);
+	if ( index < 0 ) throw RecordError("record has no field " + key.decode());
+	const uint64_t descriptor = load64(_data + HEADER_SIZE + 8 * (_count + index));
+	if ( FieldType(descriptor & 0xf) != type ) {
+		throw RecordError("record field " + key.decode() + " has a different type");
+	}
+	const size_t offset = descriptor >> 32;
+	length = (descriptor >> 4) & MAX_LENGTH;
+	if ( offset > _size || length > _size - offset ) {
+		throw RecordError("record field " + key.decode() + " is out of bounds");
+	}
+	return _data + offset;
+}
+
+int64_t Record::get_int(Symbol key) const throw(RecordError) {
+	size_t length;
+	const unsigned char* p = value(key, FIELD_INT, length);
+	if ( length != 8 ) throw RecordError("record field " + key.decode() + " has a bad length");
+	int64_t result;
+	memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+double Record::get_float(Symbol key) const throw(RecordError) {
+	size_t length;
+	const unsigned char* p = value(key, FIELD_FLOAT, length);
+	if ( length != 8 ) throw RecordError("record field " + key.decode() + " has a bad length");
+	double result;
+	memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+const void* Record::get_bytes(Symbol key, size_t& length) const throw(RecordError) {
+	return value(key, FIELD_BYTES, length);
+}
+
+std::string Record::get_string(Symbol key) const throw(RecordError) {
+	size_t length;
+	const unsigned char* p = value(key, FIELD_BYTES, length);
+	return std::string(reinterpret_cast<const char*>(p), length);
+}
+
+Record Record::get_record(Symbol key) const throw(RecordError) {
+	size_t length;
+	const unsigned char* p = value(key, FIELD_RECORD, length);
+	return Record(p, length);
+}
+
+RecordBuilder::RecordBuilder(void* buffer, size_t capacity) throw():
+	_buffer(static_cast<unsigned char*>(buffer)),
+	_capacity(capacity),
+	_end(0)
+{ }
+
+void RecordBuilder::add(Symbol key, FieldType type, const void* value, size_t length) throw(RecordError) {
+	if ( length > MAX_LENGTH ) throw RecordError("record field " + key.decode() + " is too long");
+
+	// values go at the front of the buffer for now; make sure there's
+	// room for them to be moved up behind the finished header.
+	const size_t offset = align8(_end);
+	const size_t header = HEADER_SIZE + FIELD_SIZE * (_fields.size() + 1);
+	if ( offset + length > _capacity || header > _capacity - offset - length ) {
+		throw RecordError("record buffer is full");
+	}
+	if ( header + offset > MAX_OFFSET ) throw RecordError("record is too large");
+
+	memset(_buffer + _end, 0, offset - _end);
+	memcpy(_buffer + offset, value, length);
+	_end = offset + length;
+
+	Field field;
+	field.key = key.code();
+	field.type = type;
+	field.offset = offset;
+	field.length = length;
+	_fields.push_back(field);
+}
+
+void RecordBuilder::add_int(Symbol key, int64_t value) throw(RecordError) {
+	add(key, FIELD_INT, &value, sizeof(value));
+}
+
+void RecordBuilder::add_float(Symbol key, double value) throw(RecordError) {
+	add(key, FIELD_FLOAT, &value, sizeof(value));
+}
+
+void RecordBuilder::add_bytes(Symbol key, const void* value, size_t length) throw(RecordError) {
+	add(key, FIELD_BYTES, value, length);
+}
+
+void RecordBuilder::add_string(Symbol key, const std::string& value) throw(RecordError) {
+	add(key, FIELD_BYTES, value.data(), value.size());
+}
+
+void RecordBuilder::add_record(Symbol key, const Record& value) throw(RecordError) {
+	add(key, FIELD_RECORD, value.data(), value.size());
+}
+
+size_t RecordBuilder::finish() throw(RecordError) {
+	std::sort(_fields.begin(), _fields.end());
+	for ( size_t i = 1; i < _fields.size(); ++i ) {
+		if ( _fields[i].key == _fields[i-1].key ) {
+			throw RecordError("record field " + decode(_fields[i].key) + " was added twice");
+		}
+	}
+
+	// add() made sure all of this fits.
+	const size_t count = _fields.size();
+	const size_t header = HEADER_SIZE + FIELD_SIZE * count;
+	const size_t total = header + _end;
+	memmove(_buffer + header, _buffer, _end);
+
+	store32(_buffer, RECORD_MAGIC);
+	store32(_buffer + 4, count);
+	store64(_buffer + 8, total);
+	for ( size_t i = 0; i < count; ++i ) {
+		const Field& field = _fields[i];
+		store64(_buffer + HEADER_SIZE + 8 * i, field.key);
+		const uint64_t descriptor = (uint64_t(header + field.offset) << 32) | (uint64_t(field.length) << 4) | field.type;
+		store64(_buffer + HEADER_SIZE + 8 * (count + i), descriptor);
+	}
+	_fields.clear();
+	_end = 0;
+	return total;
+}
+
+} // end namespace symbol.
@@ -0,0 +1,112 @@
+#ifndef SYMBOL_RECORD_H
+#define SYMBOL_RECORD_H
+#include "symbol.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// This error is thrown when a record is malformed, a field is missing or
+// has a different type than requested, or a builder runs out of room.
+class RecordError: public std::runtime_error {
+public:
+	explicit RecordError(const std::string& message): std::runtime_error(message) {}
+};
+
+enum FieldType {
+	FIELD_NONE = 0, // returned by Record::type() for missing fields
+	FIELD_INT = 1,
+	FIELD_FLOAT = 2,
+	FIELD_BYTES = 3,
+	FIELD_RECORD = 4
+};
+
+// A record is a self-describing set of fields named by symbol, laid out so
+// it can be read in place straight out of a network or file buffer:
+//
+//   magic "SYMR" (4 bytes), field count (4 bytes), total size (8 bytes)
+//   field names: one 8-byte symbol code per field, sorted ascending
+//   descriptors: one 8-byte word per field; the value's byte offset from
+//     the start of the record in the high 32 bits, its length in bits 4-31
+//     and its FieldType in bits 0-3
+//   values, each starting on an 8-byte boundary: ints and floats are 8
+//     bytes, byte strings are raw, and nested records are complete records.
+//
+// All numbers are in the byte order of the machine that built the record.
+
+// Read-only view of a record.  Nothing is parsed or copied up front: the
+// constructor only checks the header fits in the buffer, and each access
+// searches the sorted names and bounds-checks just the field it reads.
+// The buffer must outlive the Record.
+class Record {
+	const unsigned char* _data;
+	size_t _size;
+	size_t _count;
+
+	// index of the field, or -1 if it isn't present.
+	long find(Symbol key) const throw();
+
+	// locates a field's value, checking its type and bounds.
+	const unsigned char* value(Symbol key, FieldType type, size_t& length) const throw(RecordError);
+
+public:
+	Record(const void* data, size_t size) throw(RecordError);
+
+	// the record's bytes, e.g. for forwarding it or nesting it in another record.
+	const void* data() const throw() { return _data; }
+	size_t size() const throw() { return _size; }
+
+	size_t field_count() const throw() { return _count; }
+
+	// the name of the index'th field in sorted order.
+	Symbol key(size_t index) const throw(RecordError);
+
+	bool has(Symbol key) const throw() { return find(key) >= 0; }
+	FieldType type(Symbol key) const throw();
+
+	// field accessors throw RecordError if the field is missing or has another type.
+	int64_t get_int(Symbol key) const throw(RecordError);
+	double get_float(Symbol key) const throw(RecordError);
+	const void* get_bytes(Symbol key, size_t& length) const throw(RecordError);
+	std::string get_string(Symbol key) const throw(RecordError);
+	Record get_record(Symbol key) const throw(RecordError);
+};
+
+// Writes a record into a caller-supplied buffer.  Fields may be added in
+// any order; values are written to the buffer as they're added, and
+// finish() sorts the names and writes the header in front of them.
+class RecordBuilder {
+	struct Field {
+		uint64_t key;
+		FieldType type;
+		size_t offset;
+		size_t length;
+		bool operator<(const Field& other) const { return key < other.key; }
+	};
+
+	unsigned char* _buffer;
+	size_t _capacity;
+	size_t _end;
+	std::vector<Field> _fields;
+
+	void add(Symbol key, FieldType type, const void* value, size_t length) throw(RecordError);
+
+public:
+	RecordBuilder(void* buffer, size_t capacity) throw();
+
+	void add_int(Symbol key, int64_t value) throw(RecordError);
+	void add_float(Symbol key, double value) throw(RecordError);
+	void add_bytes(Symbol key, const void* value, size_t length) throw(RecordError);
+	void add_string(Symbol key, const std::string& value) throw(RecordError);
+	void add_record(Symbol key, const Record& value) throw(RecordError);
+
+	// completes the record and returns its size in bytes.  The builder
+	// can't be used afterwards.
+	size_t finish() throw(RecordError);
+};
+
+}
+#endif
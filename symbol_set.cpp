@@ -0,0 +1,404 @@
+#include "symbol_set.h"
+#include "symbol_sort.h"
+#include <algorithm>
+  // provides copy, lower_bound, max, min, swap
+#ifdef SYMBOL_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace symbol {
+
+// search by galloping when one array is at least this many times longer than the other.
+static const size_t GALLOP_RATIO = 32;
+
+// sets smaller than this are always arrays.
+static const size_t MIN_BITMAP_SIZE = 64;
+
+// bitmaps are only for small ranges: at most 512KB.
+static const size_t MAX_BITMAP_WORDS = 1 << 16;
+
+static uint64_t* data(std::vector<uint64_t>& v) {
+	return v.empty() ? NULL : &v[0];
+}
+
+static const uint64_t* data(const std::vector<uint64_t>& v) {
+	return v.empty() ? NULL : &v[0];
+}
+
+// the first index from lo up to n whose code is at least x, or n.  Steps
+// ahead 1, 2, 4, ... codes until it passes x, then binary searches the last
+// step, so it's fast when the answer is close to lo.
+static size_t gallop(const uint64_t* v, size_t lo, size_t n, uint64_t x) {
+	if ( lo >= n || v[lo] >= x ) return lo;
+	// v[below] < x throughout.
+	size_t below = lo;
+	size_t step = 1;
+	while ( lo + step < n && v[lo + step] < x ) {
+		below = lo + step;
+		step *= 2;
+	}
+	return std::lower_bound(v + below + 1, v + std::min(lo + step, n), x) - v;
+}
+
+#ifdef SYMBOL_AVX2_DISPATCH
+// a 4-bit mask of the codes in a[0..3] that equal any code in b[0..3]:
+// compare a against b and each rotation of b.
+SYMBOL_TARGET_AVX2 static unsigned match4(const uint64_t* a, const uint64_t* b) {
+	const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+	__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+	__m256i equal = _mm256_cmpeq_epi64(va, vb);
+	for ( unsigned r = 0; r < 3; ++r ) {
+		vb = _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1));
+		equal = _mm256_or_si256(equal, _mm256_cmpeq_epi64(va, vb));
+	}
+	return _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+}
+
+// intersect()'s merge, four codes of each array at a time, while both have
+// four left.  Advances i and j past the blocks done, and returns the new k.
+SYMBOL_TARGET_AVX2 static size_t intersect_blocks(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+	uint64_t* out, size_t& i, size_t& j, size_t k)
+{
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		for ( unsigned mask = match4(a + i, b + j); mask; mask &= mask - 1 ) {
+			out[k++] = a[i + __builtin_ctz(mask)];
+		}
+		// advance whichever block ends first, or both.
+		const uint64_t a_last = a[i + 3];
+		const uint64_t b_last = b[j + 3];
+		i += a_last <= b_last ? 4 : 0;
+		j += b_last <= a_last ? 4 : 0;
+	}
+	return k;
+}
+
+// the same for subtract().
+SYMBOL_TARGET_AVX2 static size_t subtract_blocks(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+	uint64_t* out, size_t& i, size_t& j, size_t k)
+{
+	// a's current block may match codes in several blocks of b, so collect
+	// the matches until it's done with, then keep the rest of it.
+	unsigned found = 0;
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		found |= match4(a + i, b + j);
+		const uint64_t a_last = a[i + 3];
+		const uint64_t b_last = b[j + 3];
+		if ( a_last <= b_last ) {
+			for ( unsigned keep = ~found & 0xf; keep; keep &= keep - 1 ) {
+				out[k++] = a[i + __builtin_ctz(keep)];
+			}
+			found = 0;
+			i += 4;
+		}
+		j += b_last <= a_last ? 4 : 0;
+	}
+	// some of b's earlier blocks may still match what's left of a.
+	if ( i < na ) j = std::lower_bound(b, b + j, a[i]) - b;
+	return k;
+}
+#endif
+
+size_t intersect(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw() {
+	if ( na > nb ) {
+		std::swap(a, b);
+		std::swap(na, nb);
+	}
+	if ( na == 0 ) return 0;
+	size_t k = 0;
+
+	if ( nb / na >= GALLOP_RATIO ) {
+		size_t j = 0;
+		for ( size_t i = 0; i < na && j < nb; ++i ) {
+			j = gallop(b, j, nb, a[i]);
+			if ( j < nb && b[j] == a[i] ) out[k++] = a[i];
+		}
+		return k;
+	}
+
+	size_t i = 0;
+	size_t j = 0;
+#ifdef SYMBOL_AVX2_DISPATCH
+	if ( avx2_enabled() ) k = intersect_blocks(a, na, b, nb, out, i, j, k);
+#endif
+	// out[k] is always written, but only kept on a match.
+	while ( i < na && j < nb ) {
+		const uint64_t x = a[i];
+		const uint64_t y = b[j];
+		out[k] = x;
+		k += x == y;
+		i += x <= y;
+		j += y <= x;
+	}
+	return k;
+}
+
+size_t unite(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw() {
+	if ( na < nb ) {
+		std::swap(a, b);
+		std::swap(na, nb);
+	}
+	if ( nb == 0 ) return std::copy(a, a + na, out) - out;
+	size_t i = 0;
+	size_t k = 0;
+
+	if ( na / nb >= GALLOP_RATIO ) {
+		// copy the runs of a between the codes of b.
+		for ( size_t j = 0; j < nb; ++j ) {
+			const size_t end = gallop(a, i, na, b[j]);
+			k = std::copy(a + i, a + end, out + k) - out;
+			out[k++] = b[j];
+			i = end < na && a[end] == b[j] ? end + 1 : end;
+		}
+		return std::copy(a + i, a + na, out + k) - out;
+	}
+
+	size_t j = 0;
+	while ( i < na && j < nb ) {
+		const uint64_t x = a[i];
+		const uint64_t y = b[j];
+		out[k++] = x < y ? x : y;
+		i += x <= y;
+		j += y <= x;
+	}
+	k = std::copy(a + i, a + na, out + k) - out;
+	return std::copy(b + j, b + nb, out + k) - out;
+}
+
+size_t subtract(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw() {
+	if ( na == 0 ) return 0;
+	if ( nb == 0 ) return std::copy(a, a + na, out) - out;
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
+
+	if ( nb / na >= GALLOP_RATIO ) {
+		for ( ; i < na; ++i ) {
+			j = gallop(b, j, nb, a[i]);
+			if ( j == nb || b[j] != a[i] ) out[k++] = a[i];
+		}
+		return k;
+	}
+	if ( na / nb >= GALLOP_RATIO ) {
+		// copy the runs of a between the codes of b.
+		for ( ; j < nb; ++j ) {
+			const size_t end = gallop(a, i, na, b[j]);
+			k = std::copy(a + i, a + end, out + k) - out;
+			i = end < na && a[end] == b[j] ? end + 1 : end;
+		}
+		return std::copy(a + i, a + na, out + k) - out;
+	}
+
+#ifdef SYMBOL_AVX2_DISPATCH
+	if ( avx2_enabled() ) k = subtract_blocks(a, na, b, nb, out, i, j, k);
+#endif
+	// out[k] is always written, but only kept if it's not in b.
+	while ( i < na && j < nb ) {
+		const uint64_t x = a[i];
+		const uint64_t y = b[j];
+		out[k] = x;
+		k += x < y;
+		i += x <= y;
+		j += y <= x;
+	}
+	return std::copy(a + i, a + na, out + k) - out;
+}
+
+SymbolSet::SymbolSet():
+	_base(0),
+	_size(0)
+{ }
+
+SymbolSet::SymbolSet(const Symbol* symbols, size_t n):
+	_base(0),
+	_size(0)
+{
+	std::vector<uint64_t> codes(n);
+	for ( size_t i = 0; i < n; ++i ) codes[i] = symbols[i].code();
+	codes.resize(unique(data(codes), n));
+	adopt(codes);
+}
+
+SymbolSet::SymbolSet(const uint64_t* codes, size_t n):
+	_base(0),
+	_size(0)
+{
+	std::vector<uint64_t> sorted(codes, codes + n);
+	sorted.resize(unique(data(sorted), n));
+	adopt(sorted);
+}
+
+// Both adopt()s apply the same rule, so a set's representation depends only
+// on its members, and equal sets have equal member variables.
+void SymbolSet::adopt(std::vector<uint64_t>& codes) {
+	_codes.clear();
+	_bits.clear();
+	_base = 0;
+	_size = codes.size();
+	if ( _size >= MIN_BITMAP_SIZE ) {
+		const uint64_t base = codes.front() & ~uint64_t(63);
+		const uint64_t words = (codes.back() - base) / 64 + 1;
+		if ( words <= _size && words <= MAX_BITMAP_WORDS ) {
+			_base = base;
+			_bits.resize(words, 0);
+			for ( size_t i = 0; i < _size; ++i ) {
+				const uint64_t offset = codes[i] - base;
+				_bits[offset / 64] |= uint64_t(1) << (offset % 64);
+			}
+			return;
+		}
+	}
+	_codes.swap(codes);
+}
+
+void SymbolSet::adopt(uint64_t base, std::vector<uint64_t>& bits) {
+	size_t first = 0;
+	size_t end = bits.size();
+	while ( first < end && bits[first] == 0 ) ++first;
+	while ( end > first && bits[end - 1] == 0 ) --end;
+	size_t count = 0;
+	for ( size_t w = first; w < end; ++w ) count += __builtin_popcountll(bits[w]);
+
+	if ( count >= MIN_BITMAP_SIZE && end - first <= count && end - first <= MAX_BITMAP_WORDS ) {
+		_codes.clear();
+		_bits.assign(bits.begin() + first, bits.begin() + end);
+		_base = base + 64 * first;
+		_size = count;
+		return;
+	}
+	std::vector<uint64_t> codes;
+	codes.reserve(count);
+	for ( size_t w = first; w < end; ++w ) {
+		for ( uint64_t word = bits[w]; word; word &= word - 1 ) {
+			codes.push_back(base + 64 * w + __builtin_ctzll(word));
+		}
+	}
+	adopt(codes);
+}
+
+bool SymbolSet::contains(Symbol symbol) const throw() {
+	const uint64_t code = symbol.code();
+	if ( is_bitmap() ) {
+		if ( code < _base ) return false;
+		const uint64_t offset = code - _base;
+		if ( offset / 64 >= _bits.size() ) return false;
+		return (_bits[offset / 64] >> (offset % 64)) & 1;
+	}
+	return std::binary_search(_codes.begin(), _codes.end(), code);
+}
+
+void SymbolSet::codes(std::vector<uint64_t>& codes) const {
+	if ( !is_bitmap() ) {
+		codes = _codes;
+		return;
+	}
+	codes.clear();
+	codes.reserve(_size);
+	for ( size_t w = 0; w < _bits.size(); ++w ) {
+		for ( uint64_t word = _bits[w]; word; word &= word - 1 ) {
+			codes.push_back(_base + 64 * w + __builtin_ctzll(word));
+		}
+	}
+}
+
+const std::vector<uint64_t>& SymbolSet::members(std::vector<uint64_t>& scratch) const {
+	if ( !is_bitmap() ) return _codes;
+	codes(scratch);
+	return scratch;
+}
+
+SymbolSet SymbolSet::intersect(const SymbolSet& other) const {
+	SymbolSet result;
+	if ( is_bitmap() && other.is_bitmap() ) {
+		// AND the words where the two ranges overlap.
+		const uint64_t first = std::max(_base, other._base);
+		const uint64_t last = std::min(last_code(), other.last_code());
+		if ( first > last ) return result;
+		std::vector<uint64_t> bits((last - first) / 64 + 1);
+		const uint64_t* x = &_bits[(first - _base) / 64];
+		const uint64_t* y = &other._bits[(first - other._base) / 64];
+		for ( size_t w = 0; w < bits.size(); ++w ) bits[w] = x[w] & y[w];
+		result.adopt(first, bits);
+	} else if ( is_bitmap() || other.is_bitmap() ) {
+		// test each code of the array against the bitmap.
+		const SymbolSet& bitmap = is_bitmap() ? *this : other;
+		const std::vector<uint64_t>& array = is_bitmap() ? other._codes : _codes;
+		std::vector<uint64_t> codes;
+		for ( size_t i = 0; i < array.size(); ++i ) {
+			if ( bitmap.contains(array[i]) ) codes.push_back(array[i]);
+		}
+		result.adopt(codes);
+	} else {
+		std::vector<uint64_t> codes(std::min(_size, other._size));
+		codes.resize(symbol::intersect(data(_codes), _size, data(other._codes), other._size, data(codes)));
+		result.adopt(codes);
+	}
+	return result;
+}
+
+SymbolSet SymbolSet::unite(const SymbolSet& other) const {
+	SymbolSet result;
+	if ( is_bitmap() && other.is_bitmap() ) {
+		// OR them into one bitmap, unless they're far enough apart that it'd be mostly empty.
+		const uint64_t first = std::min(_base, other._base);
+		const uint64_t words = (std::max(last_code(), other.last_code()) - first) / 64 + 1;
+		if ( words <= _bits.size() + other._bits.size() ) {
+			std::vector<uint64_t> bits(words, 0);
+			uint64_t* x = &bits[(_base - first) / 64];
+			for ( size_t w = 0; w < _bits.size(); ++w ) x[w] = _bits[w];
+			uint64_t* y = &bits[(other._base - first) / 64];
+			for ( size_t w = 0; w < other._bits.size(); ++w ) y[w] |= other._bits[w];
+			result.adopt(first, bits);
+			return result;
+		}
+	}
+	std::vector<uint64_t> x_scratch;
+	std::vector<uint64_t> y_scratch;
+	const std::vector<uint64_t>& x = members(x_scratch);
+	const std::vector<uint64_t>& y = other.members(y_scratch);
+	std::vector<uint64_t> codes(x.size() + y.size());
+	codes.resize(symbol::unite(data(x), x.size(), data(y), y.size(), data(codes)));
+	result.adopt(codes);
+	return result;
+}
+
+SymbolSet SymbolSet::subtract(const SymbolSet& other) const {
+	SymbolSet result;
+	if ( is_bitmap() ) {
+		// clear the other set's bits from a copy of this one's.
+		std::vector<uint64_t> bits(_bits);
+		if ( other.is_bitmap() ) {
+			const uint64_t first = std::max(_base, other._base);
+			const uint64_t last = std::min(last_code(), other.last_code());
+			if ( first <= last ) {
+				uint64_t* x = &bits[(first - _base) / 64];
+				const uint64_t* y = &other._bits[(first - other._base) / 64];
+				for ( size_t w = 0; w <= (last - first) / 64; ++w ) x[w] &= ~y[w];
+			}
+		} else {
+			const uint64_t last = last_code();
+			std::vector<uint64_t>::const_iterator it = std::lower_bound(other._codes.begin(), other._codes.end(), _base);
+			for ( ; it != other._codes.end() && *it <= last; ++it ) {
+				const uint64_t offset = *it - _base;
+				bits[offset / 64] &= ~(uint64_t(1) << (offset % 64));
+			}
+		}
+		result.adopt(_base, bits);
+	} else if ( other.is_bitmap() ) {
+		std::vector<uint64_t> codes;
+		for ( size_t i = 0; i < _codes.size(); ++i ) {
+			if ( !other.contains(_codes[i]) ) codes.push_back(_codes[i]);
+		}
+		result.adopt(codes);
+	} else {
+		std::vector<uint64_t> codes(_size);
+		codes.resize(symbol::subtract(data(_codes), _size, data(other._codes), other._size, data(codes)));
+		result.adopt(codes);
+	}
+	return result;
+}
+
+bool SymbolSet::operator==(const SymbolSet& other) const {
+	return _size == other._size && _base == other._base && _bits == other._bits && _codes == other._codes;
+}
+
+} // end namespace symbol.
@@ -0,0 +1,74 @@
+#ifndef SYMBOL_SET_H
+#define SYMBOL_SET_H
+#include "symbol.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// Set algebra over sorted, duplicate-free arrays of codes.  Each writes the
+// result to out in ascending order and returns its length.  out must have
+// room for min(na, nb) codes for intersect(), na + nb for unite() and na
+// for subtract(), and mustn't overlap the inputs.
+//
+// Arrays of similar size are merged without branches, and intersect() and
+// subtract() compare blocks of four codes against four at once with AVX2
+// when the processor has it.  When one array is much longer than
+// the other, the short one's codes are found in the long one by galloping
+// search instead, so the cost grows with the short array, not the long one.
+size_t intersect(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw();
+size_t unite(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw();
+size_t subtract(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out) throw();
+
+// An immutable set of symbols.  It's stored as a sorted array of codes,
+// unless the codes are packed closely enough that a bitmap over their range
+// is no bigger than the array, in which case it's stored as the bitmap.
+// Bitmaps are combined a word at a time, and tested with a shift and mask.
+class SymbolSet {
+	// members in ascending order, when stored as an array.
+	std::vector<uint64_t> _codes;
+	// when stored as a bitmap: bit i of word w is the code _base + 64 * w + i.
+	std::vector<uint64_t> _bits;
+	uint64_t _base;
+	size_t _size;
+
+	// takes the contents of a sorted, duplicate-free array, and picks the representation.
+	void adopt(std::vector<uint64_t>& codes);
+	// takes the contents of a bitmap, and picks the representation.
+	void adopt(uint64_t base, std::vector<uint64_t>& bits);
+
+	// the code of a bitmap's last bit.  (One past it may not fit in 64 bits.)
+	uint64_t last_code() const throw() { return _base + 64 * _bits.size() - 1; }
+
+	// the members in ascending order: the array itself, or the bitmap's codes written to scratch.
+	const std::vector<uint64_t>& members(std::vector<uint64_t>& scratch) const;
+
+public:
+	// New, empty set
+	SymbolSet();
+
+	// a set of the given symbols or codes, which may be in any order and may repeat.
+	SymbolSet(const Symbol* symbols, size_t n);
+	SymbolSet(const uint64_t* codes, size_t n);
+
+	size_t size() const throw() { return _size; }
+	bool empty() const throw() { return _size == 0; }
+	bool is_bitmap() const throw() { return !_bits.empty(); }
+
+	bool contains(Symbol symbol) const throw();
+
+	// replaces codes with the members, in ascending order.
+	void codes(std::vector<uint64_t>& codes) const;
+
+	SymbolSet intersect(const SymbolSet& other) const;
+	SymbolSet unite(const SymbolSet& other) const;
+	// the members of this set that aren't in other.
+	SymbolSet subtract(const SymbolSet& other) const;
+
+	bool operator==(const SymbolSet& other) const;
+	bool operator!=(const SymbolSet& other) const { return !(*this == other); }
+};
+
+}
+#endif
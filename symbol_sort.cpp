@@ -0,0 +1,236 @@
+#include "symbol_sort.h"
+#include <algorithm>
+  // provides unique, copy
+#include <pthread.h>
+#include <unistd.h>
+  // provides sysconf
+
+namespace symbol {
+
+// Symbols are reinterpreted as their codes; make sure that's valid.
+typedef char symbol_is_a_code[sizeof(Symbol) == sizeof(uint64_t) ? 1 : -1];
+
+// number of radix digits: ten 6-bit letter fields, then the top 4 bits.
+static const unsigned DIGITS = 11;
+static const unsigned RADIX = 64;
+
+// below this many codes per thread, threads cost more than they save.
+static const size_t MIN_PER_THREAD = 1 << 16;
+
+// the digit'th radix digit of a code, least significant first.
+static unsigned radix_digit(uint64_t code, unsigned digit) {
+	return (code >> (6 * digit)) & (RADIX - 1);
+}
+
+// Shared state of a parallel sort.  Each worker owns a contiguous chunk of
+// the source array, and every pass is histogram, prefix sum, scatter with a
+// barrier between each step.
+struct SortJob {
+	uint64_t* codes;
+	uint64_t* buffer;
+	size_t n;
+	unsigned threads;
+	std::vector<unsigned> digits;
+	// per thread, per bucket counts, then output positions.
+	std::vector<size_t> counts;
+	pthread_barrier_t barrier;
+	// workers wait for started, which is set once every thread that could
+	// be created has been, and threads is the number actually running.
+	pthread_mutex_t start_mutex;
+	pthread_cond_t start;
+	bool started;
+};
+
+struct SortWorker {
+	SortJob* job;
+	unsigned id;
+};
+
+static void* sort_worker(void* arg) {
+	SortWorker& worker = *static_cast<SortWorker*>(arg);
+	SortJob& job = *worker.job;
+	pthread_mutex_lock(&job.start_mutex);
+	while ( !job.started ) pthread_cond_wait(&job.start, &job.start_mutex);
+	pthread_mutex_unlock(&job.start_mutex);
+
+	const size_t begin = job.n * worker.id / job.threads;
+	const size_t end = job.n * (worker.id + 1) / job.threads;
+	size_t* counts = &job.counts[worker.id * RADIX];
+	uint64_t* src = job.codes;
+	uint64_t* dst = job.buffer;
+
+	for ( size_t pass = 0; pass < job.digits.size(); ++pass ) {
+		const unsigned digit = job.digits[pass];
+		std::fill(counts, counts + RADIX, 0);
+		for ( size_t i = begin; i < end; ++i ) ++counts[radix_digit(src[i], digit)];
+		pthread_barrier_wait(&job.barrier);
+
+		// one thread turns the counts into starting positions: bucket-major,
+		// then thread order, which keeps the sort stable.
+		if ( worker.id == 0 ) {
+			size_t position = 0;
+			for ( unsigned bucket = 0; bucket < RADIX; ++bucket ) {
+				for ( unsigned t = 0; t < job.threads; ++t ) {
+					size_t& count = job.counts[t * RADIX + bucket];
+					const size_t start = position;
+					position += count;
+					count = start;
+				}
+			}
+		}
+		pthread_barrier_wait(&job.barrier);
+
+		for ( size_t i = begin; i < end; ++i ) {
+			dst[counts[radix_digit(src[i], digit)]++] = src[i];
+		}
+		// nobody may start the next histogram until every scatter is done.
+		pthread_barrier_wait(&job.barrier);
+		std::swap(src, dst);
+	}
+	return NULL;
+}
+
+static unsigned choose_threads(size_t n, unsigned threads) {
+	if ( threads == 0 ) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = processors > 0 ? processors : 1;
+	}
+	const size_t useful = n / MIN_PER_THREAD;
+	if ( useful < threads ) threads = useful;
+	return threads > 0 ? threads : 1;
+}
+
+void sort(uint64_t* codes, size_t n, unsigned threads) {
+	if ( n < 2 ) return;
+	threads = choose_threads(n, threads);
+	std::vector<uint64_t> buffer;
+
+	if ( threads == 1 ) {
+		// count every digit in one read of the input.  A digit is constant
+		// if all the codes fall in one bucket, and then its pass is skipped.
+		std::vector<size_t> histogram(DIGITS * RADIX, 0);
+		for ( size_t i = 0; i < n; ++i ) {
+			const uint64_t code = codes[i];
+			for ( unsigned digit = 0; digit < DIGITS; ++digit ) {
+				++histogram[digit * RADIX + radix_digit(code, digit)];
+			}
+		}
+
+		uint64_t* src = codes;
+		uint64_t* dst = NULL;
+		for ( unsigned digit = 0; digit < DIGITS; ++digit ) {
+			if ( histogram[digit * RADIX + radix_digit(codes[0], digit)] == n ) continue;
+			if ( dst == NULL ) {
+				buffer.resize(n);
+				dst = &buffer[0];
+			}
+			size_t positions[RADIX];
+			size_t position = 0;
+			for ( unsigned bucket = 0; bucket < RADIX; ++bucket ) {
+				positions[bucket] = position;
+				position += histogram[digit * RADIX + bucket];
+			}
+			for ( size_t i = 0; i < n; ++i ) {
+				dst[positions[radix_digit(src[i], digit)]++] = src[i];
+			}
+			std::swap(src, dst);
+		}
+		if ( src != codes ) std::copy(src, src + n, codes);
+		return;
+	}
+
+	// the workers count one digit per pass, so here we only need to know
+	// which digits vary: those with bits set in some codes but not others.
+	uint64_t any = 0;
+	uint64_t all = ~uint64_t(0);
+	for ( size_t i = 0; i < n; ++i ) {
+		any |= codes[i];
+		all &= codes[i];
+	}
+	std::vector<unsigned> digits;
+	for ( unsigned digit = 0; digit < DIGITS; ++digit ) {
+		if ( radix_digit(any ^ all, digit) ) digits.push_back(digit);
+	}
+	if ( digits.empty() ) return;
+	buffer.resize(n);
+
+	SortJob job;
+	job.codes = codes;
+	job.buffer = &buffer[0];
+	job.n = n;
+	job.digits = digits;
+	job.started = false;
+	pthread_mutex_init(&job.start_mutex, NULL);
+	pthread_cond_init(&job.start, NULL);
+
+	// the calling thread is worker zero.
+	std::vector<SortWorker> workers(threads);
+	std::vector<pthread_t> handles(threads);
+	for ( unsigned t = 0; t < threads; ++t ) {
+		workers[t].job = &job;
+		workers[t].id = t;
+	}
+	// if a thread can't be created, split the work over the ones that were.
+	unsigned running = 1;
+	while ( running < threads && pthread_create(&handles[running], NULL, sort_worker, &workers[running]) == 0 ) {
+		++running;
+	}
+	job.threads = running;
+	job.counts.resize(running * RADIX);
+	pthread_barrier_init(&job.barrier, NULL, running);
+	pthread_mutex_lock(&job.start_mutex);
+	job.started = true;
+	pthread_cond_broadcast(&job.start);
+	pthread_mutex_unlock(&job.start_mutex);
+
+	sort_worker(&workers[0]);
+	for ( unsigned t = 1; t < running; ++t ) pthread_join(handles[t], NULL);
+	pthread_barrier_destroy(&job.barrier);
+	pthread_cond_destroy(&job.start);
+	pthread_mutex_destroy(&job.start_mutex);
+
+	// an odd number of passes leaves the result in the buffer.
+	if ( digits.size() % 2 ) std::copy(buffer.begin(), buffer.end(), codes);
+}
+
+void sort(Symbol* symbols, size_t n, unsigned threads) {
+	sort(reinterpret_cast<uint64_t*>(symbols), n, threads);
+}
+
+size_t unique(uint64_t* codes, size_t n, unsigned threads) {
+	sort(codes, n, threads);
+	return std::unique(codes, codes + n) - codes;
+}
+
+size_t unique(Symbol* symbols, size_t n, unsigned threads) {
+	return unique(reinterpret_cast<uint64_t*>(symbols), n, threads);
+}
+
+void group_count(const uint64_t* codes, size_t n,
+	std::vector<std::pair<uint64_t, uint64_t> >& groups, unsigned threads)
+{
+	std::vector<uint64_t> sorted(codes, codes + n);
+	groups.clear();
+	if ( n == 0 ) return;
+	sort(&sorted[0], n, threads);
+	for ( size_t i = 0; i < n; ) {
+		size_t j = i + 1;
+		while ( j < n && sorted[j] == sorted[i] ) ++j;
+		groups.push_back(std::make_pair(sorted[i], j - i));
+		i = j;
+	}
+}
+
+void group_count(const Symbol* symbols, size_t n,
+	std::vector<std::pair<Symbol, uint64_t> >& groups, unsigned threads)
+{
+	std::vector<std::pair<uint64_t, uint64_t> > code_groups;
+	group_count(reinterpret_cast<const uint64_t*>(symbols), n, code_groups, threads);
+	groups.clear();
+	groups.reserve(code_groups.size());
+	for ( size_t i = 0; i < code_groups.size(); ++i ) {
+		groups.push_back(std::make_pair(Symbol(code_groups[i].first), code_groups[i].second));
+	}
+}
+
+} // end namespace symbol.
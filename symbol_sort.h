@@ -0,0 +1,37 @@
+#ifndef SYMBOL_SORT_H
+#define SYMBOL_SORT_H
+#include "symbol.h"
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// Bulk operations on arrays of symbols or codes.  Symbols sort in code
+// order (the same order as Symbol::operator<), using an LSD radix sort with
+// one pass per 6-bit letter field and a final pass for the top four bits.
+// Passes whose digit is the same for every element are skipped, so short
+// exact symbols sort in as many passes as their longest identifier has
+// letters.
+//
+// threads is the number of worker threads; zero means one per processor.
+// Small inputs are always sorted on the calling thread.
+
+// sorts in place, ascending.
+void sort(uint64_t* codes, size_t n, unsigned threads = 0);
+void sort(Symbol* symbols, size_t n, unsigned threads = 0);
+
+// sorts in place and moves the distinct values to the front; returns how many there are.
+size_t unique(uint64_t* codes, size_t n, unsigned threads = 0);
+size_t unique(Symbol* symbols, size_t n, unsigned threads = 0);
+
+// replaces groups with each distinct value and the number of times it
+// occurs, in ascending order.  The input is left unchanged.
+void group_count(const uint64_t* codes, size_t n,
+	std::vector<std::pair<uint64_t, uint64_t> >& groups, unsigned threads = 0);
+void group_count(const Symbol* symbols, size_t n,
+	std::vector<std::pair<Symbol, uint64_t> >& groups, unsigned threads = 0);
+
+}
+#endif
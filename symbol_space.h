@@ -1,7 +1,10 @@
 #ifndef SYMBOL_SPACE_H
 #define SYMBOL_SPACE_H
 #include "symbol.h"
+#include "symbol_filter.h"
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
 #include <stdint.h>
 
 namespace symbol {
@@ -17,10 +20,37 @@ class Space {
     };
 
     Node* head;
+
+    // optional filter of every key ever set, to skip walking the list on misses.
+    SymbolFilter* filter;
+
+    // ~Space deletes the list, so a member-wise copy would delete it
+    // twice.  Use PersistentSpace (symbol_persistent.h) for cheap snapshots.
+    Space(const Space&);
+    Space& operator=(const Space&);
+
+    // number of lookups get_many() keeps in flight at once.
+    static const size_t BATCH_GROUP = 8;
+
+    // orders batch positions by their key.
+    class KeyOrder {
+        const Symbol* keys;
+    public:
+        KeyOrder(const Symbol* k): keys(k) {}
+        bool operator()(size_t lhs, size_t rhs) const { return keys[lhs] < keys[rhs]; }
+    };
+
+    // returns the first position from next on whose key might be present,
+    // answering NULL for the keys the filter rules out on the way.
+    size_t skip_filtered(const Symbol* keys, size_t n, size_t next, Value** out) {
+        if ( filter == NULL ) return next;
+        while ( next < n && !filter->contains(keys[next]) ) out[next++] = NULL;
+        return next;
+    }
 public:
 
     // New, empty space
-	Space(): head(NULL) {}
+	Space(): head(NULL), filter(NULL) {}
 	~Space(){
         Node* prev = head;
         while ( prev ) {
@@ -33,6 +63,8 @@ public:
     // returns a pointer to the Value, or NULL if it 
     // isn't found in the space.
     Value* get(Symbol key) {
+        // a definite miss in the filter saves walking the list.
+        if ( filter != NULL && !filter->contains(key) ) return NULL;
         Node* next = head;
         while ( next != NULL ) {
             if ( key == next->key ) {
@@ -49,6 +81,7 @@ public:
     }
 
     void set(Symbol key, Value value) {
+        if ( filter != NULL ) filter->insert(key);
         if ( head == NULL ) {
             // short circuit case of empty Space
             head = new Node(key, value);
@@ -86,6 +119,90 @@ public:
         }
     }
 
+    // Looks up n keys at once, storing each get() result in out.  Rather than
+    // walking the list for one key at a time, BATCH_GROUP walks are
+    // interleaved, each advancing one node per round after prefetching it,
+    // so the cache misses of different keys overlap instead of queueing.
+    void get_many(const Symbol* keys, size_t n, Value** out) {
+        Node* cursor[BATCH_GROUP];
+        size_t slot[BATCH_GROUP];
+        size_t next = skip_filtered(keys, n, 0, out);
+        size_t active = 0;
+        for ( ; active < BATCH_GROUP && next < n; ++active ) {
+            cursor[active] = head;
+            slot[active] = next;
+            next = skip_filtered(keys, n, next + 1, out);
+        }
+        while ( active > 0 ) {
+            for ( size_t i = 0; i < active; ) {
+                Node* node = cursor[i];
+                const Symbol key = keys[slot[i]];
+                if ( node != NULL && node->key < key ) {
+                    // not there yet: step forward and let the other walks run
+                    // while the next node is fetched.
+                    cursor[i] = node->next;
+                    SYMBOL_PREFETCH(node->next);
+                    ++i;
+                    continue;
+                }
+                // the list is sorted, so we either found it or never will.
+                out[slot[i]] = ( node != NULL && node->key == key ) ? &node->value : NULL;
+                if ( next < n ) {
+                    // start the next key in this walk's place
+                    cursor[i] = head;
+                    slot[i] = next;
+                    next = skip_filtered(keys, n, next + 1, out);
+                    ++i;
+                } else {
+                    // retire the walk by moving the last one into its place
+                    --active;
+                    cursor[i] = cursor[active];
+                    slot[i] = slot[active];
+                }
+            }
+        }
+    }
+
+    // Sets n keys at once; equivalent to calling set() for each in turn.
+    // The batch is sorted by key so the whole batch is merged into the
+    // list in a single pass, prefetching ahead as it goes.
+    void set_many(const Symbol* keys, const Value* values, size_t n) {
+        std::vector<size_t> order(n);
+        for ( size_t i = 0; i < n; ++i ) order[i] = i;
+        // stable, so the last of any repeated keys is set last, as with set().
+        std::stable_sort(order.begin(), order.end(), KeyOrder(keys));
+
+        Node** link = &head;
+        for ( size_t i = 0; i < n; ++i ) {
+            const Symbol key = keys[order[i]];
+            if ( filter != NULL ) filter->insert(key);
+            while ( *link != NULL && (*link)->key < key ) {
+                link = &(*link)->next;
+                if ( *link != NULL ) SYMBOL_PREFETCH((*link)->next);
+            }
+            if ( *link != NULL && (*link)->key == key ) {
+                // replace the value
+                (*link)->value = values[order[i]];
+            } else {
+                // insert before the first larger key, keeping the list sorted
+                Node* new_node = new Node(key, values[order[i]]);
+                new_node->next = *link;
+                *link = new_node;
+            }
+        }
+    }
+
+    // Attaches a filter that get() and get_many() consult before walking the
+    // list, so lookups of absent keys usually return immediately.  Every key
+    // already in the space is inserted, and set() inserts new keys; deleted
+    // keys stay in the filter, which costs only false positives.  The filter
+    // must outlive the space or be detached by attaching NULL.
+    void attach(SymbolFilter* f) {
+        filter = f;
+        if ( filter == NULL ) return;
+        for ( Node* node = head; node != NULL; node = node->next ) filter->insert(node->key);
+    }
+
     void del(Symbol key) {
         // short circuit special cases so the general case is straightforward.
         if ( head == NULL ) {
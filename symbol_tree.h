@@ -0,0 +1,572 @@
+#ifndef SYMBOL_TREE_H
+#define SYMBOL_TREE_H
+#include "symbol.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace symbol {
+
+// An adaptive radix tree keyed by Symbol.  Keys are split into 11 digits:
+// the top four bits of the code (which hold the lossy flag) followed by the
+// ten 6-bit letter fields, first letter first.  Inner nodes grow and shrink
+// between 4, 16, 48 and 64 children as their occupancy changes, and chains
+// of single-child nodes are collapsed away, so memory is proportional to
+// the number of distinct prefixes.
+//
+// Iteration is in digit order, which for exact symbols is the same as
+// ASCII order of their identifiers ("get" < "getName" < "get_name" < "gets").
+// Like Space, the API is get/set/del, with get returning NULL on a miss.
+template<typename Value>
+class Tree {
+    // number of digits in a key.
+    static const unsigned DIGITS = 11;
+
+    enum NodeType { NODE4, NODE16, NODE48, NODE64 };
+
+    class Leaf {
+    public:
+        Symbol key;
+        Value value;
+        Leaf(Symbol k, const Value& v): key(k), value(v) {}
+    };
+
+    // Every inner node branches on a single digit, its depth.  All keys
+    // below it agree on the digits before that, which are stored in prefix;
+    // the digits skipped between a node and its parent are the compressed path.
+    class Node {
+    public:
+        unsigned char type;
+        unsigned char count;
+        unsigned char depth;
+        uint64_t prefix;
+        Node(NodeType t, unsigned d, uint64_t p): type(t), count(0), depth(d), prefix(p) {}
+    };
+
+    // 4 and 16 child nodes keep sorted digits alongside their children.
+    template<NodeType TYPE, unsigned CAPACITY>
+    class SmallNode: public Node {
+    public:
+        unsigned char digits[CAPACITY];
+        void* children[CAPACITY];
+        SmallNode(unsigned d, uint64_t p): Node(TYPE, d, p) {}
+    };
+    typedef SmallNode<NODE4, 4> Node4;
+    typedef SmallNode<NODE16, 16> Node16;
+
+    // 48 child nodes map each digit to a slot (plus one, zero is empty).
+    class Node48: public Node {
+    public:
+        unsigned char slots[64];
+        void* children[48];
+        Node48(unsigned d, uint64_t p): Node(NODE48, d, p) {
+            for ( unsigned i = 0; i < 64; ++i ) slots[i] = 0;
+        }
+    };
+
+    // 64 child nodes index their children directly by digit.
+    class Node64: public Node {
+    public:
+        void* children[64];
+        Node64(unsigned d, uint64_t p): Node(NODE64, d, p) {
+            for ( unsigned i = 0; i < 64; ++i ) children[i] = NULL;
+        }
+    };
+
+    // child pointers are either Nodes or Leaves; leaves are tagged in the low bit.
+    static bool is_leaf(void* p) { return reinterpret_cast<uintptr_t>(p) & 1; }
+    static Leaf* as_leaf(void* p) { return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(1)); }
+    static void* tag_leaf(Leaf* leaf) { return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(leaf) | 1); }
+
+    // the digit of a code at the given depth.
+    static unsigned digit(uint64_t code, unsigned depth) {
+        if ( depth == 0 ) return code >> 60;
+        return (code >> (6 * (depth - 1))) & 63;
+    }
+
+    // selects the digits of a code before the given depth.
+    static uint64_t prefix_mask(unsigned depth) {
+        if ( depth == 0 ) return 0;
+        return (uint64_t(15) << 60) | ((uint64_t(1) << (6 * (depth - 1))) - 1);
+    }
+
+    // the first depth at which two codes have different digits.
+    static unsigned mismatch(uint64_t a, uint64_t b) {
+        unsigned depth = 0;
+        while ( depth < DIGITS && digit(a, depth) == digit(b, depth) ) ++depth;
+        return depth;
+    }
+
+    void* root;
+    size_t _size;
+
+    // number of lookups get_many() keeps in flight at once.
+    static const size_t BATCH_GROUP = 8;
+
+    // Takes one step of a lookup: from p to the child for the key, or NULL
+    // if the key isn't there.  Leaves are returned as-is.  The next node is
+    // prefetched so batched lookups can work on other keys meanwhile.
+    static void* step(void* p, uint64_t code) {
+        Node* node = static_cast<Node*>(p);
+        if ( (code & prefix_mask(node->depth)) != node->prefix ) return NULL;
+        void** child = find_child(node, digit(code, node->depth));
+        if ( child == NULL ) return NULL;
+        void* next = *child;
+        SYMBOL_PREFETCH(is_leaf(next) ? static_cast<void*>(as_leaf(next)) : next);
+        return next;
+    }
+
+    // copying would take a deep copy of every node; copy the pairs from each() instead.
+    Tree(const Tree&);
+    Tree& operator=(const Tree&);
+
+    // returns the slot holding the child for the given digit, or NULL.
+    static void** find_child(Node* node, unsigned d) {
+        switch ( node->type ) {
+        case NODE4: {
+            Node4* n = static_cast<Node4*>(node);
+            for ( unsigned i = 0; i < n->count; ++i ) if ( n->digits[i] == d ) return &n->children[i];
+            return NULL;
+        }
+        case NODE16: {
+            Node16* n = static_cast<Node16*>(node);
+            for ( unsigned i = 0; i < n->count; ++i ) if ( n->digits[i] == d ) return &n->children[i];
+            return NULL;
+        }
+        case NODE48: {
+            Node48* n = static_cast<Node48*>(node);
+            return n->slots[d] ? &n->children[n->slots[d] - 1] : NULL;
+        }
+        default: {
+            Node64* n = static_cast<Node64*>(node);
+            return n->children[d] ? &n->children[d] : NULL;
+        }
+        }
+    }
+
+    // copies a node's digits and children out in digit order.  Returns the count.
+    static unsigned list_children(Node* node, unsigned char* digits, void** children) {
+        unsigned count = 0;
+        switch ( node->type ) {
+        case NODE4: {
+            Node4* n = static_cast<Node4*>(node);
+            for ( ; count < n->count; ++count ) {
+                digits[count] = n->digits[count];
+                children[count] = n->children[count];
+            }
+            break;
+        }
+        case NODE16: {
+            Node16* n = static_cast<Node16*>(node);
+            for ( ; count < n->count; ++count ) {
+                digits[count] = n->digits[count];
+                children[count] = n->children[count];
+            }
+            break;
+        }
+        case NODE48: {
+            Node48* n = static_cast<Node48*>(node);
+            for ( unsigned d = 0; d < 64; ++d ) {
+                if ( n->slots[d] ) {
+                    digits[count] = d;
+                    children[count++] = n->children[n->slots[d] - 1];
+                }
+            }
+            break;
+        }
+        default: {
+            Node64* n = static_cast<Node64*>(node);
+            for ( unsigned d = 0; d < 64; ++d ) {
+                if ( n->children[d] ) {
+                    digits[count] = d;
+                    children[count++] = n->children[d];
+                }
+            }
+        }
+        }
+        return count;
+    }
+
+    // appends a child to a small node whose digits are all less than d.
+    template<typename Small>
+    static void append(Small* n, unsigned d, void* child) {
+        n->digits[n->count] = d;
+        n->children[n->count] = child;
+        ++n->count;
+    }
+
+    // builds the smallest node type that holds the given children.
+    static Node* build(unsigned depth, uint64_t prefix, const unsigned char* digits, void** children, unsigned count) {
+        if ( count <= 4 ) {
+            Node4* n = new Node4(depth, prefix);
+            for ( unsigned i = 0; i < count; ++i ) append(n, digits[i], children[i]);
+            return n;
+        } else if ( count <= 16 ) {
+            Node16* n = new Node16(depth, prefix);
+            for ( unsigned i = 0; i < count; ++i ) append(n, digits[i], children[i]);
+            return n;
+        } else if ( count <= 48 ) {
+            Node48* n = new Node48(depth, prefix);
+            for ( unsigned i = 0; i < count; ++i ) {
+                n->children[i] = children[i];
+                n->slots[digits[i]] = i + 1;
+            }
+            n->count = count;
+            return n;
+        } else {
+            Node64* n = new Node64(depth, prefix);
+            for ( unsigned i = 0; i < count; ++i ) n->children[digits[i]] = children[i];
+            n->count = count;
+            return n;
+        }
+    }
+
+    static void delete_node(Node* node) {
+        switch ( node->type ) {
+        case NODE4: delete static_cast<Node4*>(node); break;
+        case NODE16: delete static_cast<Node16*>(node); break;
+        case NODE48: delete static_cast<Node48*>(node); break;
+        default: delete static_cast<Node64*>(node);
+        }
+    }
+
+    // replaces *ref (which holds node) with a node of a different size.
+    static void resize(void** ref, Node* node, unsigned char* digits, void** children, unsigned count) {
+        *ref = build(node->depth, node->prefix, digits, children, count);
+        delete_node(node);
+    }
+
+    // inserts a child for a digit that isn't present, growing the node if it's full.
+    static void add_child(void** ref, Node* node, unsigned d, void* child) {
+        unsigned char digits[64];
+        void* children[64];
+        switch ( node->type ) {
+        case NODE4:
+        case NODE16: {
+            const unsigned capacity = node->type == NODE4 ? 4 : 16;
+            unsigned char* node_digits = node->type == NODE4 ?
+                static_cast<Node4*>(node)->digits : static_cast<Node16*>(node)->digits;
+            void** node_children = node->type == NODE4 ?
+                static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+            if ( node->count < capacity ) {
+                // shift larger digits up to keep them sorted
+                unsigned i = node->count;
+                while ( i > 0 && node_digits[i-1] > d ) {
+                    node_digits[i] = node_digits[i-1];
+                    node_children[i] = node_children[i-1];
+                    --i;
+                }
+                node_digits[i] = d;
+                node_children[i] = child;
+                ++node->count;
+                return;
+            }
+            break;
+        }
+        case NODE48: {
+            Node48* n = static_cast<Node48*>(node);
+            if ( n->count < 48 ) {
+                n->children[n->count] = child;
+                n->slots[d] = ++n->count;
+                return;
+            }
+            break;
+        }
+        default:
+            static_cast<Node64*>(node)->children[d] = child;
+            ++node->count;
+            return;
+        }
+
+        // full: grow into the next size up.
+        unsigned count = list_children(node, digits, children);
+        unsigned i = count;
+        while ( i > 0 && digits[i-1] > d ) {
+            digits[i] = digits[i-1];
+            children[i] = children[i-1];
+            --i;
+        }
+        digits[i] = d;
+        children[i] = child;
+        resize(ref, node, digits, children, count + 1);
+    }
+
+    // removes the child for a digit, shrinking the node or collapsing it
+    // into its last child as occupancy drops.
+    static void remove_child(void** ref, Node* node, unsigned d) {
+        unsigned char digits[64];
+        void* children[64];
+        unsigned count = list_children(node, digits, children);
+        unsigned i = 0;
+        while ( i < count && digits[i] != d ) ++i;
+        for ( ; i + 1 < count; ++i ) {
+            digits[i] = digits[i+1];
+            children[i] = children[i+1];
+        }
+        --count;
+
+        if ( count == 1 ) {
+            // the remaining child keeps its own prefix, so it can replace us directly.
+            *ref = children[0];
+            delete_node(node);
+        } else if ( (node->type == NODE16 && count <= 3) || (node->type == NODE48 && count <= 12) ||
+                    (node->type == NODE64 && count <= 40) ) {
+            resize(ref, node, digits, children, count);
+        } else if ( node->type == NODE48 ) {
+            // move the last slot into the hole to keep the children dense.
+            Node48* n = static_cast<Node48*>(node);
+            const unsigned hole = n->slots[d] - 1;
+            n->slots[d] = 0;
+            --n->count;
+            if ( hole != n->count ) {
+                for ( unsigned j = 0; j < 64; ++j ) {
+                    if ( n->slots[j] == n->count + 1 ) n->slots[j] = hole + 1;
+                }
+                n->children[hole] = n->children[n->count];
+            }
+        } else if ( node->type == NODE64 ) {
+            static_cast<Node64*>(node)->children[d] = NULL;
+            --node->count;
+        } else {
+            // small nodes: write back the compacted arrays.
+            unsigned char* node_digits = node->type == NODE4 ?
+                static_cast<Node4*>(node)->digits : static_cast<Node16*>(node)->digits;
+            void** node_children = node->type == NODE4 ?
+                static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+            for ( unsigned j = 0; j < count; ++j ) {
+                node_digits[j] = digits[j];
+                node_children[j] = children[j];
+            }
+            node->count = count;
+        }
+    }
+
+    // a new Node4 at the given depth holding two children with different digits there.
+    static Node* split(unsigned depth, uint64_t code, void* a, uint64_t a_code, void* b, uint64_t b_code) {
+        Node4* n = new Node4(depth, code & prefix_mask(depth));
+        if ( digit(a_code, depth) < digit(b_code, depth) ) {
+            append(n, digit(a_code, depth), a);
+            append(n, digit(b_code, depth), b);
+        } else {
+            append(n, digit(b_code, depth), b);
+            append(n, digit(a_code, depth), a);
+        }
+        return n;
+    }
+
+    static void destroy(void* p) {
+        if ( p == NULL ) return;
+        if ( is_leaf(p) ) {
+            delete as_leaf(p);
+            return;
+        }
+        unsigned char digits[64];
+        void* children[64];
+        Node* node = static_cast<Node*>(p);
+        unsigned count = list_children(node, digits, children);
+        for ( unsigned i = 0; i < count; ++i ) destroy(children[i]);
+        delete_node(node);
+    }
+
+    template<typename Visitor>
+    static void walk(void* p, Visitor& visit) {
+        if ( is_leaf(p) ) {
+            Leaf* leaf = as_leaf(p);
+            visit(leaf->key, leaf->value);
+            return;
+        }
+        unsigned char digits[64];
+        void* children[64];
+        unsigned count = list_children(static_cast<Node*>(p), digits, children);
+        for ( unsigned i = 0; i < count; ++i ) walk(children[i], visit);
+    }
+
+public:
+    // New, empty tree
+    Tree(): root(NULL), _size(0) {}
+    ~Tree() { destroy(root); }
+
+    // number of keys in the tree.
+    size_t size() const { return _size; }
+
+    // returns a pointer to the Value, or NULL if it
+    // isn't found in the tree.
+    Value* get(Symbol key) {
+        const uint64_t code = key.code();
+        void* p = root;
+        while ( p != NULL ) {
+            if ( is_leaf(p) ) {
+                Leaf* leaf = as_leaf(p);
+                return leaf->key == key ? &leaf->value : NULL;
+            }
+            Node* node = static_cast<Node*>(p);
+            if ( (code & prefix_mask(node->depth)) != node->prefix ) return NULL;
+            void** child = find_child(node, digit(code, node->depth));
+            if ( child == NULL ) return NULL;
+            p = *child;
+        }
+        return NULL;
+    }
+
+    void set(Symbol key, const Value& value) {
+        const uint64_t code = key.code();
+        void** ref = &root;
+        while ( true ) {
+            void* p = *ref;
+            if ( p == NULL ) {
+                *ref = tag_leaf(new Leaf(key, value));
+                break;
+            }
+            if ( is_leaf(p) ) {
+                Leaf* leaf = as_leaf(p);
+                if ( leaf->key == key ) {
+                    // replace the value
+                    leaf->value = value;
+                    return;
+                }
+                // lazy expansion: split where the two keys first differ.
+                const uint64_t other = leaf->key.code();
+                *ref = split(mismatch(code, other), code, p, other, tag_leaf(new Leaf(key, value)), code);
+                break;
+            }
+            Node* node = static_cast<Node*>(p);
+            if ( (code & prefix_mask(node->depth)) != node->prefix ) {
+                // the key leaves the compressed path: split the path.
+                const unsigned depth = mismatch(code, node->prefix);
+                *ref = split(depth, code, p, node->prefix, tag_leaf(new Leaf(key, value)), code);
+                break;
+            }
+            const unsigned d = digit(code, node->depth);
+            void** child = find_child(node, d);
+            if ( child == NULL ) {
+                add_child(ref, node, d, tag_leaf(new Leaf(key, value)));
+                break;
+            }
+            ref = child;
+        }
+        ++_size;
+    }
+
+    // Looks up n keys at once, storing each get() result in out.  Rather than
+    // descending the tree for one key at a time, BATCH_GROUP descents are
+    // interleaved one level per round with each next node prefetched, so
+    // the cache misses of different keys overlap instead of queueing.
+    void get_many(const Symbol* keys, size_t n, Value** out) {
+        void* cursor[BATCH_GROUP];
+        size_t slot[BATCH_GROUP];
+        size_t next = 0;
+        size_t active = 0;
+        for ( ; active < BATCH_GROUP && next < n; ++active, ++next ) {
+            cursor[active] = root;
+            slot[active] = next;
+        }
+        while ( active > 0 ) {
+            for ( size_t i = 0; i < active; ) {
+                void* p = cursor[i];
+                if ( p != NULL && !is_leaf(p) ) {
+                    cursor[i] = step(p, keys[slot[i]].code());
+                    ++i;
+                    continue;
+                }
+                Leaf* leaf = p != NULL ? as_leaf(p) : NULL;
+                out[slot[i]] = ( leaf != NULL && leaf->key == keys[slot[i]] ) ? &leaf->value : NULL;
+                if ( next < n ) {
+                    // start the next key in this descent's place
+                    cursor[i] = root;
+                    slot[i] = next++;
+                    ++i;
+                } else {
+                    // retire the descent by moving the last one into its place
+                    --active;
+                    cursor[i] = cursor[active];
+                    slot[i] = slot[active];
+                }
+            }
+        }
+    }
+
+    // Sets n keys at once; equivalent to calling set() for each in turn.
+    // Each group of BATCH_GROUP keys is first looked up with get_many(),
+    // which pulls their paths into cache together, then set one by one.
+    void set_many(const Symbol* keys, const Value* values, size_t n) {
+        Value* found[BATCH_GROUP];
+        for ( size_t first = 0; first < n; first += BATCH_GROUP ) {
+            const size_t count = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+            get_many(keys + first, count, found);
+            for ( size_t i = 0; i < count; ++i ) {
+                // leaves never move, so existing keys can be replaced in place.
+                if ( found[i] != NULL ) *found[i] = values[first + i];
+                else set(keys[first + i], values[first + i]);
+            }
+        }
+    }
+
+    void del(Symbol key) {
+        const uint64_t code = key.code();
+        void** ref = &root;
+        void** parent_ref = NULL;
+        Node* parent = NULL;
+        while ( *ref != NULL ) {
+            void* p = *ref;
+            if ( is_leaf(p) ) {
+                Leaf* leaf = as_leaf(p);
+                if ( leaf->key != key ) return;
+                delete leaf;
+                if ( parent == NULL ) *ref = NULL;
+                else remove_child(parent_ref, parent, digit(code, parent->depth));
+                --_size;
+                return;
+            }
+            Node* node = static_cast<Node*>(p);
+            if ( (code & prefix_mask(node->depth)) != node->prefix ) return;
+            void** child = find_child(node, digit(code, node->depth));
+            if ( child == NULL ) return;
+            parent_ref = ref;
+            parent = node;
+            ref = child;
+        }
+    }
+
+    // calls visit(key, value) for every key in digit order.
+    template<typename Visitor>
+    void each(Visitor& visit) {
+        if ( root != NULL ) walk(root, visit);
+    }
+
+    // calls visit(key, value) in digit order for every exact symbol whose
+    // identifier starts with the identifier of prefix, e.g. each_prefix("get", ...)
+    // visits "get", "getName" and "get_name".  The prefix must be an exact
+    // symbol, and lossy keys are never visited since their letters aren't
+    // stored in order.  Only the subtree under the prefix is touched.
+    template<typename Visitor>
+    void each_prefix(Symbol prefix, Visitor& visit) {
+        const uint64_t code = prefix.code();
+        // the prefix fixes the top digit plus each of its letters.
+        unsigned length = 1;
+        while ( length < DIGITS && digit(code, length) != 0 ) ++length;
+        const uint64_t mask = prefix_mask(length);
+
+        void* p = root;
+        while ( p != NULL ) {
+            if ( is_leaf(p) ) {
+                Leaf* leaf = as_leaf(p);
+                if ( (leaf->key.code() & mask) == (code & mask) ) visit(leaf->key, leaf->value);
+                return;
+            }
+            Node* node = static_cast<Node*>(p);
+            const uint64_t common = prefix_mask(node->depth < length ? node->depth : length);
+            if ( (node->prefix & common) != (code & common) ) return;
+            if ( node->depth >= length ) {
+                // everything below here matches the prefix.
+                walk(p, visit);
+                return;
+            }
+            void** child = find_child(node, digit(code, node->depth));
+            if ( child == NULL ) return;
+            p = *child;
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+// symdict: builds and queries reverse dictionaries for lossy symbol codes.
+//
+//   symdict build OUT PATH...     collect identifiers from source files
+//   symdict decode DICT [CODE...] print the identifiers for each code
+//
+// build reads every file under each directory it's given, skipping names
+// that start with '.' (e.g. .git), and doesn't follow links to directories.
+// decode reads codes from stdin if none are given, one per line or
+// separated by whitespace, in decimal or 0x hex.  Each output line is the
+// code followed by its candidate identifiers separated by '|', or by its
+// lossy decoding in brackets if the dictionary doesn't know it.
+#include "symbol_dictionary.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+  // provides strtoull
+#include <dirent.h>
+  // provides opendir, readdir, closedir
+#include <sys/stat.h>
+  // provides stat, lstat
+
+static int usage() {
+	std::cerr << "usage: symdict build OUT PATH...\n"
+		<< "       symdict decode DICT [CODE...]\n";
+	return 2;
+}
+
+// adds the identifiers in a file, or in every file under a directory.
+// Returns false, after saying why, if something can't be read.
+static bool add_path(symbol::DictionaryBuilder& builder, const std::string& path, bool top) {
+	struct stat info;
+	// links given on the command line are followed, links found in a walk are not.
+	if ( (top ? stat(path.c_str(), &info) : lstat(path.c_str(), &info)) != 0 ) {
+		std::cerr << "symdict: unable to read " << path << std::endl;
+		return false;
+	}
+	if ( S_ISDIR(info.st_mode) ) {
+		DIR* dir = opendir(path.c_str());
+		if ( dir == NULL ) {
+			std::cerr << "symdict: unable to read " << path << std::endl;
+			return false;
+		}
+		bool ok = true;
+		while ( struct dirent* entry = readdir(dir) ) {
+			if ( entry->d_name[0] == '.' ) continue;
+			ok &= add_path(builder, path + "/" + entry->d_name, false);
+		}
+		closedir(dir);
+		return ok;
+	}
+	if ( !S_ISREG(info.st_mode) ) {
+		// links, devices and pipes met in a walk are skipped; named ones are errors.
+		if ( !top ) return true;
+		std::cerr << "symdict: not a file or directory: " << path << std::endl;
+		return false;
+	}
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::ostringstream text;
+	if ( in ) text << in.rdbuf();
+	if ( !in || in.bad() ) {
+		std::cerr << "symdict: unable to read " << path << std::endl;
+		return false;
+	}
+	builder.add_text(text.str());
+	return true;
+}
+
+static int build(int argc, char** argv) {
+	symbol::DictionaryBuilder builder;
+	for ( int i = 3; i < argc; ++i ) {
+		if ( !add_path(builder, argv[i], true) ) return 1;
+	}
+	builder.write(argv[2]);
+	std::cerr << "symdict: wrote " << builder.size() << " codes to " << argv[2] << std::endl;
+	return 0;
+}
+
+static bool print(const symbol::Dictionary& dictionary, const std::string& word, std::vector<std::string>& candidates) {
+	char* end = NULL;
+	const uint64_t code = strtoull(word.c_str(), &end, 0);
+	if ( word.empty() || *end != '\0' ) {
+		std::cerr << "symdict: not a symbol code: " << word << std::endl;
+		return false;
+	}
+	std::cout << word << ' ';
+	if ( dictionary.lookup(code, candidates) == 0 ) {
+		std::cout << '[' << symbol::decode(code) << "]\n";
+		return true;
+	}
+	for ( size_t i = 0; i < candidates.size(); ++i ) {
+		if ( i ) std::cout << '|';
+		std::cout << candidates[i];
+	}
+	std::cout << '\n';
+	return true;
+}
+
+static int decode(int argc, char** argv) {
+	symbol::Dictionary dictionary(argv[2]);
+	std::vector<std::string> candidates;
+	bool ok = true;
+	if ( argc > 3 ) {
+		for ( int i = 3; i < argc; ++i ) ok &= print(dictionary, argv[i], candidates);
+	} else {
+		std::string word;
+		while ( std::cin >> word ) ok &= print(dictionary, word, candidates);
+	}
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	std::ios::sync_with_stdio(false);
+	if ( argc < 3 ) return usage();
+	const std::string command = argv[1];
+	try {
+		if ( command == "build" ) return build(argc, argv);
+		if ( command == "decode" ) return decode(argc, argv);
+	} catch ( symbol::DictionaryError& e ) {
+		std::cerr << "symdict: " << e.what() << std::endl;
+		return 1;
+	}
+	return usage();
+}
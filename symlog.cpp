@@ -0,0 +1,36 @@
+// symlog: formats a binary symbol log dump.
+//
+//   symlog DUMP [DICT]
+//
+// prints each entry of a dump written by SymbolLog::dump(), one per line.
+// If a dictionary built by symdict is given, lossy symbols are printed as
+// the identifiers they came from.
+#include "symbol_log.h"
+#include "symbol_dictionary.h"
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char** argv) {
+	if ( argc < 2 || argc > 3 ) {
+		std::cerr << "usage: symlog DUMP [DICT]\n";
+		return 2;
+	}
+	std::ios::sync_with_stdio(false);
+	std::ifstream in(argv[1], std::ios::binary);
+	if ( !in ) {
+		std::cerr << "symlog: unable to read " << argv[1] << std::endl;
+		return 1;
+	}
+	try {
+		if ( argc == 3 ) {
+			symbol::Dictionary dictionary(argv[2]);
+			symbol::format_log(in, std::cout, &dictionary);
+		} else {
+			symbol::format_log(in, std::cout);
+		}
+	} catch ( std::runtime_error& e ) {
+		std::cerr << "symlog: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
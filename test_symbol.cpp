@@ -9,6 +9,24 @@
 #include<sstream>
 #include "symbol.h"
 #include "symbol_space.h"
+#include "symbol_column.h"
+#include "symbol_tree.h"
+#include "symbol_counter.h"
+#include "symbol_sort.h"
+#include "symbol_record.h"
+#include "symbol_persistent.h"
+#include "symbol_filter.h"
+#include "symbol_dictionary.h"
+#include "symbol_set.h"
+#include "symbol_log.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <pthread.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // global variable for verbose mode. Test functions will do additional output if set
 bool verbose = true;
@@ -24,6 +42,17 @@ bool testAPI();
 bool option(char** argv, char option);
 
 bool testSymbolSpace();
+bool testColumn();
+bool testTree();
+bool testBatch();
+bool testCounter();
+bool testSort();
+bool testRecord();
+bool testPersistentSpace();
+bool testFilter();
+bool testDictionary();
+bool testSymbolSet();
+bool testLog();
 
 int main(int argc, char** argv) {
 	std::cout << std::boolalpha;
@@ -91,6 +120,27 @@ int main(int argc, char** argv) {
 	passed &= testDecodeReencode("abc_1234aBcd_de", false);
 
     passed &= testSymbolSpace();
+	passed &= testColumn();
+	passed &= testTree();
+	passed &= testBatch();
+	passed &= testCounter();
+	passed &= testSort();
+	passed &= testRecord();
+	passed &= testPersistentSpace();
+	passed &= testFilter();
+	passed &= testDictionary();
+	passed &= testSymbolSet();
+	passed &= testLog();
+
+	// the bulk operations again with the portable code, if they used AVX2.
+	if ( symbol::avx2_enabled() ) {
+		if ( verbose ) std::cout << "retesting without AVX2" << std::endl;
+		symbol::set_avx2_enabled(false);
+		passed &= testColumn();
+		passed &= testFilter();
+		passed &= testSymbolSet();
+		symbol::set_avx2_enabled(true);
+	}
 
 	if ( passed ) std::cout << "passed." << std::endl;
 	else std::cout << "failed!" << std::endl;
@@ -398,3 +448,910 @@ bool testSymbolSpace() {
     return passed;
 
 }
+
+// identifiers "k0", "k1", ... for bulk tests.
+symbol::Symbol numberedKey(int i) {
+	std::stringstream identifier;
+	identifier << "k" << i;
+	return identifier.str();
+}
+
+// n full-width pseudo-random codes from xorshift64, the same ones every run.
+std::vector<uint64_t> randomCodes(size_t n) {
+	std::vector<uint64_t> codes;
+	uint64_t state = 88172645463325252UL;
+	for ( size_t i = 0; i < n; ++i ) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		codes.push_back(state);
+	}
+	return codes;
+}
+
+// encodes the codes as a column, then checks both the bulk decode and
+// random access recover every code.
+bool testColumnRoundTrip(const char* name, const std::vector<uint64_t>& codes) {
+	std::vector<uint64_t> buffer;
+	symbol::encode_column(codes.empty() ? NULL : &codes[0], codes.size(), buffer);
+	symbol::Column column(buffer.empty() ? NULL : &buffer[0], buffer.size());
+
+	bool passed = (column.size() == codes.size());
+	std::vector<uint64_t> decoded(codes.size());
+	if ( !codes.empty() ) column.decode(&decoded[0]);
+	passed &= (decoded == codes);
+	for ( size_t i = 0; i < codes.size(); ++i ) {
+		passed &= (column.get(i) == codes[i]);
+	}
+
+	if ( verbose || !passed ) {
+		std::cout << "column " << name << ": " << codes.size() << " codes in "
+			<< buffer.size() << " words, " << (passed ? "recovered." : "NOT RECOVERED!") << std::endl;
+	}
+	return passed;
+}
+
+bool testColumn() {
+	bool passed = true;
+	std::vector<uint64_t> codes;
+	passed &= testColumnRoundTrip("empty", codes);
+
+	// one constant block and a partial block.
+	codes.assign(300, symbol::Symbol("constant").code());
+	passed &= testColumnRoundTrip("constant", codes);
+
+	// short exact symbols only use the low bits, so frame-of-reference wins.
+	codes.clear();
+	const char* words[] = { "id", "name", "x", "y", "z", "count", "value", "key" };
+	for ( size_t i = 0; i < 1000; ++i ) codes.push_back(symbol::Symbol(words[(i * 7) % 8]).code());
+	passed &= testColumnRoundTrip("exact", codes);
+
+	// a few lossy symbols are spread over the whole range: dictionary.
+	codes.clear();
+	const char* long_words[] = { "aVeryLongIdentifier", "anotherLongIdentifier", "yetAnotherLongOne" };
+	for ( size_t i = 0; i < 1000; ++i ) codes.push_back(symbol::Symbol(long_words[(i * 5) % 3]).code());
+	passed &= testColumnRoundTrip("dictionary", codes);
+
+	// long runs of lossy symbols: run-length.
+	codes.clear();
+	for ( size_t i = 0; i < 1000; ++i ) codes.push_back(symbol::Symbol(long_words[(i / 100) % 3]).code());
+	passed &= testColumnRoundTrip("runs", codes);
+
+	// pseudo-random full-width codes still round trip at 64 bits.
+	codes = randomCodes(777);
+	passed &= testColumnRoundTrip("random", codes);
+
+	// offsets of every width, so each unpacker runs.
+	for ( unsigned bits = 1; bits < 64; ++bits ) {
+		std::vector<uint64_t> offsets(600);
+		for ( size_t i = 0; i < offsets.size(); ++i ) offsets[i] = 1000 + ((codes[i] >> 1) >> (63 - bits));
+		passed &= testColumnRoundTrip("widths", offsets);
+	}
+
+	// a dictionary index past the last entry is detected.
+	std::vector<uint64_t> dictionary;
+	for ( size_t i = 0; i < 256; ++i ) dictionary.push_back(symbol::Symbol(long_words[i % 3]).code());
+	std::vector<uint64_t> corrupt;
+	symbol::encode_column(&dictionary[0], dictionary.size(), corrupt);
+	// the block follows the header and its offset: a block header, the 3 entries, then 2-bit indexes.
+	passed &= ((corrupt[5] & 0xff) == 2);
+	corrupt[9] |= 3;
+	bool caught = false;
+	try {
+		symbol::Column column(&corrupt[0], corrupt.size());
+		column.decode_block(0, &dictionary[0]);
+	} catch ( symbol::ColumnError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+
+	// a truncated buffer is detected rather than read past the end.
+	std::vector<uint64_t> buffer;
+	symbol::encode_column(&codes[0], codes.size(), buffer);
+	caught = false;
+	try {
+		symbol::Column column(&buffer[0], buffer.size() - 1);
+		std::vector<uint64_t> decoded(codes.size());
+		column.decode(&decoded[0]);
+	} catch ( symbol::ColumnError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+
+	// a count so large that rounding it up to blocks wraps around to zero blocks.
+	buffer[1] = ~uint64_t(0);
+	buffer[3] = 0;
+	caught = false;
+	try {
+		symbol::Column column(&buffer[0], buffer.size());
+		column.get(100000000);
+	} catch ( symbol::ColumnError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+
+	if ( !passed ) {
+		std::cout << "failed symbol::Column tests." << std::endl;
+	}
+	return passed;
+}
+
+// collects the keys visited by Tree::each and Tree::each_prefix.
+struct CollectKeys {
+	std::vector<symbol::Symbol> keys;
+	void operator()(symbol::Symbol key, int&) { keys.push_back(key); }
+};
+
+// checks the tree against a std::map holding the same keys.
+bool sameKeys(symbol::Tree<int>& tree, const std::map<uint64_t, int>& expected) {
+	bool passed = (tree.size() == expected.size());
+	for ( std::map<uint64_t, int>::const_iterator it = expected.begin(); it != expected.end(); ++it ) {
+		int* value = tree.get(it->first);
+		passed &= (value != NULL && *value == it->second);
+	}
+	return passed;
+}
+
+bool testTree() {
+	bool passed = true;
+	symbol::Tree<int> tree;
+	std::map<uint64_t, int> expected;
+
+	// nothing to get from an empty tree
+	passed &= (tree.get(symbol::Symbol("x")) == NULL);
+	tree.del(symbol::Symbol("x"));
+
+	// enough keys sharing prefixes to grow nodes through every size.
+	const char* stems[] = { "get", "set", "del", "is", "x" };
+	const char* letters = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+	int value = 0;
+	for ( size_t s = 0; s < 5; ++s ) {
+		for ( size_t i = 0; i < 63; ++i ) {
+			std::string identifier = std::string(stems[s]) + letters[i];
+			tree.set(identifier, value);
+			expected[symbol::Symbol(identifier).code()] = value++;
+			if ( i % 3 == 0 ) {
+				identifier += "_s";
+				tree.set(identifier, value);
+				expected[symbol::Symbol(identifier).code()] = value++;
+			}
+		}
+		tree.set(symbol::Symbol(stems[s]), value);
+		expected[symbol::Symbol(stems[s]).code()] = value++;
+	}
+	tree.set(symbol::Symbol("aVeryLongIdentifier"), value);
+	expected[symbol::Symbol("aVeryLongIdentifier").code()] = value++;
+	passed &= sameKeys(tree, expected);
+	passed &= (tree.get(symbol::Symbol("getting")) == NULL);
+	passed &= (tree.get(symbol::Symbol("zzz")) == NULL);
+
+	// overwriting doesn't add a key
+	tree.set(symbol::Symbol("get"), -1);
+	expected[symbol::Symbol("get").code()] = -1;
+	passed &= sameKeys(tree, expected);
+
+	// iteration is in code order for the whole tree...
+	CollectKeys all;
+	tree.each(all);
+	passed &= (all.keys.size() == expected.size());
+	for ( size_t i = 1; i < all.keys.size(); ++i ) passed &= (all.keys[i-1].decode() < all.keys[i].decode() || all.keys[i].is_lossy());
+
+	// ...and for prefixes, which visit exactly the matching identifiers.
+	CollectKeys get;
+	tree.each_prefix(symbol::Symbol("get"), get);
+	passed &= (get.keys.size() == 1 + 63 + 21);
+	for ( size_t i = 0; i < get.keys.size(); ++i ) passed &= (get.keys[i].decode().compare(0, 3, "get") == 0);
+	for ( size_t i = 1; i < get.keys.size(); ++i ) passed &= (get.keys[i-1].decode() < get.keys[i].decode());
+	CollectKeys get0;
+	tree.each_prefix(symbol::Symbol("get0"), get0);
+	passed &= (get0.keys.size() == 2 && get0.keys[0] == symbol::Symbol("get0"));
+	CollectKeys missing;
+	tree.each_prefix(symbol::Symbol("got"), missing);
+	passed &= missing.keys.empty();
+
+	// delete most keys, shrinking nodes back down.
+	for ( std::map<uint64_t, int>::iterator it = expected.begin(); it != expected.end(); ) {
+		if ( it->second % 4 != 0 ) {
+			tree.del(it->first);
+			expected.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	tree.del(symbol::Symbol("notThere"));
+	passed &= sameKeys(tree, expected);
+	for ( std::map<uint64_t, int>::iterator it = expected.begin(); it != expected.end(); ++it ) tree.del(it->first);
+	passed &= (tree.size() == 0);
+	passed &= (tree.get(symbol::Symbol("x")) == NULL);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::Tree tests." << std::endl;
+	}
+	return passed;
+}
+
+// checks get_many() against get() for a Space or Tree, including misses.
+template<typename Container>
+bool sameAsGet(Container& container, const std::vector<symbol::Symbol>& keys) {
+	std::vector<int*> found(keys.size());
+	container.get_many(&keys[0], keys.size(), &found[0]);
+	bool passed = true;
+	for ( size_t i = 0; i < keys.size(); ++i ) {
+		passed &= (found[i] == container.get(keys[i]));
+	}
+	return passed;
+}
+
+template<typename Container>
+bool testBatchFor(Container& container) {
+	bool passed = true;
+	std::vector<symbol::Symbol> keys;
+	std::vector<int> values;
+	for ( int i = 0; i < 200; ++i ) {
+		std::stringstream identifier;
+		identifier << "key" << (i * 37) % 200;
+		keys.push_back(identifier.str());
+		values.push_back(i);
+	}
+	// a repeated key: the last value wins, as with set().
+	keys.push_back(keys[0]);
+	values.push_back(-1);
+
+	// set only the even positions, so odd keys are misses.
+	std::vector<symbol::Symbol> even_keys;
+	std::vector<int> even_values;
+	for ( size_t i = 0; i < keys.size(); i += 2 ) {
+		even_keys.push_back(keys[i]);
+		even_values.push_back(values[i]);
+	}
+	container.set_many(&even_keys[0], &even_values[0], even_keys.size());
+	passed &= sameAsGet(container, keys);
+	passed &= (*container.get(keys[2]) == 2);
+	passed &= (*container.get(keys[0]) == -1);
+	passed &= (container.get(keys[1]) == NULL);
+
+	// now set everything, overwriting the even keys.
+	container.set_many(&keys[0], &values[0], keys.size());
+	passed &= sameAsGet(container, keys);
+	for ( size_t i = 1; i + 1 < keys.size(); ++i ) {
+		passed &= (*container.get(keys[i]) == values[i]);
+	}
+	passed &= (*container.get(keys[0]) == -1);
+	return passed;
+}
+
+bool testBatch() {
+	bool passed = true;
+	symbol::Space<int> space;
+	passed &= testBatchFor(space);
+	symbol::Tree<int> tree;
+	passed &= testBatchFor(tree);
+
+	if ( !passed ) {
+		std::cout << "failed get_many/set_many tests." << std::endl;
+	}
+	return passed;
+}
+
+// the keys used by the counter tests: key i occurs i+1 times.
+std::vector<symbol::Symbol> counterKeys() {
+	std::vector<symbol::Symbol> keys;
+	for ( int i = 0; i < 50; ++i ) {
+		std::stringstream identifier;
+		identifier << "field" << i;
+		for ( int j = 0; j <= i; ++j ) keys.push_back(identifier.str());
+	}
+	return keys;
+}
+
+void* countKeys(void* counter) {
+	std::vector<symbol::Symbol> keys = counterKeys();
+	for ( size_t i = 0; i < keys.size(); ++i ) static_cast<symbol::SymbolCounter*>(counter)->increment(keys[i]);
+	return NULL;
+}
+
+// uses up every thread-specific key the process has left, or puts them back.
+void takeAllKeys(std::vector<pthread_key_t>& keys) {
+	pthread_key_t key;
+	while ( pthread_key_create(&key, NULL) == 0 ) keys.push_back(key);
+}
+void returnKeys(std::vector<pthread_key_t>& keys) {
+	for ( size_t i = 0; i < keys.size(); ++i ) pthread_key_delete(keys[i]);
+	keys.clear();
+}
+
+bool testCounter() {
+	bool passed = true;
+	std::vector<symbol::Symbol> keys = counterKeys();
+
+	// exact counts from several threads at once.
+	symbol::SymbolCounter exact(symbol::SymbolCounter::EXACT, 4);
+	pthread_t threads[4];
+	for ( int i = 0; i < 4; ++i ) pthread_create(&threads[i], NULL, countKeys, &exact);
+	for ( int i = 0; i < 4; ++i ) pthread_join(threads[i], NULL);
+	passed &= (exact.count(symbol::Symbol("field0")) == 4);
+	passed &= (exact.count(symbol::Symbol("field49")) == 200);
+	passed &= (exact.count(symbol::Symbol("missing")) == 0);
+
+	// batched increments and the empty symbol.
+	exact.increment_many(&keys[0], keys.size());
+	exact.increment(symbol::Symbol(""), 7);
+	passed &= (exact.count(symbol::Symbol("field49")) == 250);
+	passed &= (exact.count(symbol::Symbol("")) == 7);
+
+	std::vector<std::pair<symbol::Symbol, uint64_t> > top;
+	exact.top(3, top);
+	passed &= (top.size() == 3);
+	passed &= (top[0].first == symbol::Symbol("field49") && top[0].second == 250);
+	passed &= (top[2].first == symbol::Symbol("field47") && top[2].second == 240);
+
+	// merging adds the other counter's totals, including merging into itself.
+	symbol::SymbolCounter other;
+	other.increment(symbol::Symbol("field0"), 100);
+	exact.merge(other);
+	passed &= (exact.count(symbol::Symbol("field0")) == 105);
+	exact.merge(exact);
+	passed &= (exact.count(symbol::Symbol("field0")) == 210);
+	exact.clear();
+	passed &= (exact.count(symbol::Symbol("field0")) == 0);
+
+	// approximate counts never underestimate, and a small sketch still
+	// finds the heaviest keys.
+	symbol::SymbolCounter approximate(symbol::SymbolCounter::APPROXIMATE, 2, 256, 16);
+	approximate.increment_many(&keys[0], keys.size());
+	for ( int i = 0; i < 50; ++i ) {
+		std::stringstream identifier;
+		identifier << "field" << i;
+		passed &= (approximate.count(symbol::Symbol(identifier.str())) >= uint64_t(i + 1));
+	}
+	approximate.top(3, top);
+	passed &= (top.size() == 3);
+	passed &= (top[0].first == symbol::Symbol("field49") && top[0].second >= 50);
+	passed &= (top[1].first == symbol::Symbol("field48"));
+
+	// heavy hitters survive a long tail of keys churning through the candidates.
+	symbol::SymbolCounter churn(symbol::SymbolCounter::APPROXIMATE, 1, 4096, 4);
+	for ( int i = 0; i < 5000; ++i ) {
+		churn.increment(numberedKey(i + 10));
+		if ( i % 3 == 0 ) churn.increment(numberedKey(1));
+		if ( i % 5 == 0 ) churn.increment(numberedKey(2));
+	}
+	churn.top(2, top);
+	passed &= (top.size() == 2 && top[0].first == numberedKey(1) && top[1].first == numberedKey(2));
+
+	// without a thread-specific key left, threads share the shards but still count.
+	std::vector<pthread_key_t> taken;
+	takeAllKeys(taken);
+	{
+		symbol::SymbolCounter keyless(symbol::SymbolCounter::EXACT, 2);
+		for ( int i = 0; i < 4; ++i ) pthread_create(&threads[i], NULL, countKeys, &keyless);
+		for ( int i = 0; i < 4; ++i ) pthread_join(threads[i], NULL);
+		passed &= (keyless.count(symbol::Symbol("field49")) == 200);
+	}
+	returnKeys(taken);
+
+	bool caught = false;
+	try {
+		approximate.merge(other);
+	} catch ( std::invalid_argument& e ) {
+		caught = true;
+	}
+	passed &= caught;
+
+	if ( !passed ) {
+		std::cout << "failed symbol::SymbolCounter tests." << std::endl;
+	}
+	return passed;
+}
+
+// radix sorts the codes and checks the result against std::sort.
+bool testSortAgainstStd(std::vector<uint64_t> codes, unsigned threads) {
+	std::vector<uint64_t> expected(codes);
+	std::sort(expected.begin(), expected.end());
+	symbol::sort(codes.empty() ? NULL : &codes[0], codes.size(), threads);
+	bool passed = (codes == expected);
+	if ( verbose || !passed ) {
+		std::cout << "radix sort of " << codes.size() << " codes on " << threads << " threads "
+			<< (passed ? "matched." : "DID NOT MATCH!") << std::endl;
+	}
+	return passed;
+}
+
+bool testSort() {
+	bool passed = true;
+	std::vector<uint64_t> codes;
+	passed &= testSortAgainstStd(codes, 1);
+
+	// short exact symbols, which only need a few passes.
+	const char* words[] = { "b", "a", "ab", "zz", "A", "_", "Zed", "0" };
+	for ( size_t i = 0; i < 1000; ++i ) codes.push_back(symbol::Symbol(words[(i * 5) % 8]).code());
+	passed &= testSortAgainstStd(codes, 1);
+
+	// full-width codes, large enough to be split over several threads.
+	codes = randomCodes(300000);
+	// mix in some lossy symbols and some duplicates.
+	for ( size_t i = 0; i < codes.size(); i += 3 ) codes[i] &= 0xfff;
+	passed &= testSortAgainstStd(codes, 1);
+	passed &= testSortAgainstStd(codes, 4);
+
+	// a constant column skips every pass.
+	passed &= testSortAgainstStd(std::vector<uint64_t>(100000, 42), 2);
+
+	// unique and group_count on symbols.
+	std::vector<symbol::Symbol> symbols;
+	for ( size_t i = 0; i < 1000; ++i ) symbols.push_back(symbol::Symbol(words[(i * 5) % 8]));
+	std::vector<std::pair<symbol::Symbol, uint64_t> > groups;
+	symbol::group_count(&symbols[0], symbols.size(), groups);
+	passed &= (groups.size() == 8);
+	passed &= (groups[0].first == symbol::Symbol("0") && groups[0].second == 125);
+	for ( size_t i = 1; i < groups.size(); ++i ) passed &= (groups[i-1].first < groups[i].first);
+
+	size_t distinct = symbol::unique(&symbols[0], symbols.size());
+	passed &= (distinct == 8);
+	for ( size_t i = 0; i < distinct; ++i ) passed &= (symbols[i] == groups[i].first);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::sort tests." << std::endl;
+	}
+	return passed;
+}
+
+bool testRecord() {
+	bool passed = true;
+
+	// a nested record to embed.
+	char inner_buffer[256];
+	symbol::RecordBuilder inner_builder(inner_buffer, sizeof(inner_buffer));
+	inner_builder.add_int(symbol::Symbol("x"), 3);
+	inner_builder.add_int(symbol::Symbol("y"), -4);
+	symbol::Record inner(inner_buffer, inner_builder.finish());
+
+	// fields are added out of order; the builder sorts them.
+	uint64_t buffer[128];
+	symbol::RecordBuilder builder(buffer, sizeof(buffer));
+	builder.add_string(symbol::Symbol("name"), "diagram.svg");
+	builder.add_float(symbol::Symbol("scale"), 1.5);
+	builder.add_int(symbol::Symbol("id"), 1234567890123L);
+	builder.add_record(symbol::Symbol("origin"), inner);
+	builder.add_bytes(symbol::Symbol("empty"), "", 0);
+	for ( int i = 0; i < 30; ++i ) {
+		std::stringstream identifier;
+		identifier << "f" << i;
+		builder.add_int(symbol::Symbol(identifier.str()), i);
+	}
+	size_t size = builder.finish();
+	passed &= (size % 8 == 0 && size <= sizeof(buffer));
+
+	symbol::Record record(buffer, size);
+	passed &= (record.field_count() == 35);
+	passed &= (record.get_string(symbol::Symbol("name")) == "diagram.svg");
+	passed &= (record.get_float(symbol::Symbol("scale")) == 1.5);
+	passed &= (record.get_int(symbol::Symbol("id")) == 1234567890123L);
+	passed &= (record.get_int(symbol::Symbol("f17")) == 17);
+	passed &= (record.get_string(symbol::Symbol("empty")) == "");
+	symbol::Record origin = record.get_record(symbol::Symbol("origin"));
+	passed &= (origin.get_int(symbol::Symbol("x")) == 3);
+	passed &= (origin.get_int(symbol::Symbol("y")) == -4);
+	for ( size_t i = 1; i < record.field_count(); ++i ) passed &= (record.key(i-1) < record.key(i));
+
+	// missing fields and wrong types
+	passed &= !record.has(symbol::Symbol("missing"));
+	passed &= (record.type(symbol::Symbol("missing")) == symbol::FIELD_NONE);
+	passed &= (record.type(symbol::Symbol("scale")) == symbol::FIELD_FLOAT);
+	int errors = 0;
+	try { record.get_int(symbol::Symbol("missing")); } catch ( symbol::RecordError& e ) { ++errors; }
+	try { record.get_int(symbol::Symbol("name")); } catch ( symbol::RecordError& e ) { ++errors; }
+
+	// truncated records, duplicate fields and full buffers are rejected.
+	try { symbol::Record truncated(buffer, size - 8); } catch ( symbol::RecordError& e ) { ++errors; }
+	char small[64];
+	symbol::RecordBuilder duplicate(small, sizeof(small));
+	duplicate.add_int(symbol::Symbol("a"), 1);
+	duplicate.add_int(symbol::Symbol("a"), 2);
+	try { duplicate.finish(); } catch ( symbol::RecordError& e ) { ++errors; }
+	symbol::RecordBuilder full(small, sizeof(small));
+	try { full.add_string(symbol::Symbol("a"), std::string(64, 'x')); } catch ( symbol::RecordError& e ) { ++errors; }
+	passed &= (errors == 5);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::Record tests." << std::endl;
+	}
+	return passed;
+}
+
+bool testPersistentSpace() {
+	bool passed = true;
+	typedef symbol::PersistentSpace<int> Space;
+	symbol::Symbol x("x");
+	symbol::Symbol y("y");
+
+	// every update returns a new version and leaves the old one alone.
+	Space empty;
+	Space one = empty.set(x, 1);
+	Space two = one.set(y, 2);
+	Space changed = two.set(x, 3);
+	Space removed = changed.del(y);
+	passed &= (empty.size() == 0 && empty.get(x) == NULL);
+	passed &= (one.size() == 1 && *one.get(x) == 1 && one.get(y) == NULL);
+	passed &= (two.size() == 2 && *two.get(x) == 1 && *two.get(y) == 2);
+	passed &= (changed.size() == 2 && *changed.get(x) == 3 && *changed.get(y) == 2);
+	passed &= (removed.size() == 1 && *removed.get(x) == 3 && removed.get(y) == NULL);
+	passed &= (removed.del(y).size() == 1);
+
+	// snapshots are copies.
+	Space snapshot = two;
+	two = two.del(x);
+	passed &= (*snapshot.get(x) == 1 && two.get(x) == NULL);
+
+	// bulk build with a transient, deep enough to need several levels.
+	Space::Transient transient;
+	for ( int i = 0; i < 5000; ++i ) transient.set(numberedKey(i), i);
+	Space built = transient.persistent();
+
+	// updating the transient after a snapshot leaves the snapshot intact.
+	for ( int i = 0; i < 5000; i += 2 ) transient.del(numberedKey(i));
+	transient.set(numberedKey(1), -1);
+	passed &= (built.size() == 5000 && transient.size() == 2500);
+	for ( int i = 0; i < 5000; ++i ) {
+		passed &= (*built.get(numberedKey(i)) == i);
+		const int* value = transient.get(numberedKey(i));
+		if ( i % 2 == 0 ) passed &= (value == NULL);
+		else passed &= (value != NULL && *value == (i == 1 ? -1 : i));
+	}
+
+	// persistent deletes shrink back to empty.
+	Space shrinking = built;
+	for ( int i = 0; i < 5000; ++i ) shrinking = shrinking.del(numberedKey(i));
+	passed &= (shrinking.size() == 0 && shrinking.get(numberedKey(0)) == NULL);
+	passed &= (built.size() == 5000 && *built.get(numberedKey(4999)) == 4999);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::PersistentSpace tests." << std::endl;
+	}
+	return passed;
+}
+
+bool testFilter() {
+	bool passed = true;
+	symbol::SymbolFilter filter(1000);
+	for ( int i = 0; i < 1000; ++i ) filter.insert(numberedKey(i));
+
+	// no false negatives, and few false positives.
+	std::vector<symbol::Symbol> keys;
+	for ( int i = 0; i < 2000; ++i ) keys.push_back(numberedKey(i));
+	bool found[2000];
+	filter.contains_many(&keys[0], keys.size(), found);
+	int false_positives = 0;
+	for ( int i = 0; i < 2000; ++i ) {
+		passed &= (found[i] == filter.contains(keys[i]));
+		if ( i < 1000 ) passed &= found[i];
+		else if ( found[i] ) ++false_positives;
+	}
+	if ( verbose ) std::cout << "filter false positives: " << false_positives << " of 1000" << std::endl;
+	passed &= (false_positives < 50);
+	filter.clear();
+	passed &= !filter.contains(numberedKey(0));
+
+	// a space with a filter attached answers the same as without.
+	symbol::Space<int> space;
+	space.set(numberedKey(0), 0);
+	symbol::SymbolFilter space_filter(100);
+	space.attach(&space_filter);
+	for ( int i = 1; i < 100; ++i ) space.set(numberedKey(i), i);
+	space.del(numberedKey(50));
+	passed &= (*space.get(numberedKey(0)) == 0);
+	passed &= (*space.get(numberedKey(99)) == 99);
+	passed &= (space.get(numberedKey(50)) == NULL);
+	passed &= (space.get(numberedKey(100)) == NULL);
+	passed &= sameAsGet(space, keys);
+	space.attach(NULL);
+	passed &= sameAsGet(space, keys);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::SymbolFilter tests." << std::endl;
+	}
+	return passed;
+}
+
+bool testDictionary() {
+	bool passed = true;
+	const std::string path = "/tmp/test_symbol.dict";
+
+	symbol::DictionaryBuilder builder;
+	passed &= (builder.add_text("int make_connection_pool(size_t n); // see getConnectionPool") == 2);
+	passed &= !builder.add("not valid!");
+	// short identifiers and decoded lossy symbols add nothing.
+	passed &= builder.add("short");
+	passed &= builder.add(symbol::Symbol("some_long_identifier").decode());
+	passed &= (builder.size() == 2);
+	std::vector<std::string> long_identifiers;
+	for ( int i = 0; i < 1000; ++i ) {
+		std::ostringstream out;
+		out << "long_identifier_" << i;
+		long_identifiers.push_back(out.str());
+		builder.add(out.str());
+	}
+	// these share a code; the last is also its decoding, so it's not kept.
+	passed &= (builder.add("abc_01234a___de") && builder.add("abc_001234a__de") && builder.add("abc_1234a____de"));
+	builder.write(path);
+
+	symbol::Dictionary dictionary(path);
+	std::vector<std::string> candidates;
+	passed &= (dictionary.lookup(symbol::Symbol("make_connection_pool"), candidates) == 1);
+	passed &= (candidates.size() == 1 && candidates[0] == "make_connection_pool");
+	passed &= (dictionary.resolve(symbol::Symbol("getConnectionPool")) == "getConnectionPool");
+	for ( size_t i = 0; i < long_identifiers.size(); ++i ) {
+		passed &= (dictionary.resolve(symbol::Symbol(long_identifiers[i])) == long_identifiers[i]);
+	}
+
+	// colliding identifiers are all candidates, and resolve to the lossy decoding.
+	symbol::Symbol collision("abc_01234a___de");
+	passed &= (symbol::Symbol("abc_001234a__de") == collision && symbol::Symbol("abc_1234a____de") == collision);
+	passed &= (dictionary.lookup(collision, candidates) == 2 && candidates.size() == 2);
+	passed &= (std::count(candidates.begin(), candidates.end(), "abc_01234a___de") == 1);
+	passed &= (std::count(candidates.begin(), candidates.end(), "abc_001234a__de") == 1);
+	passed &= (dictionary.resolve(collision) == collision.decode());
+
+	// exact symbols need no dictionary; unknown lossy symbols have no candidates.
+	passed &= (dictionary.lookup(symbol::Symbol("short"), candidates) == 1 && candidates[0] == "short");
+	symbol::Symbol unknown("not_in_the_corpus");
+	passed &= (dictionary.lookup(unknown, candidates) == 0 && candidates.empty());
+	passed &= (dictionary.resolve(unknown) == unknown.decode());
+
+	// an empty dictionary still works.
+	symbol::DictionaryBuilder().write(path);
+	symbol::Dictionary empty(path);
+	passed &= (empty.lookup(unknown, candidates) == 0);
+
+	// files that aren't dictionaries are rejected.
+	bool caught = false;
+	try {
+		symbol::Dictionary missing("/tmp/test_symbol.no_such_dict");
+	} catch ( symbol::DictionaryError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+	{
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		out << "SYMDICT1 but not really a dictionary at all";
+	}
+	caught = false;
+	try {
+		symbol::Dictionary corrupt(path);
+	} catch ( symbol::DictionaryError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+	remove(path.c_str());
+
+	if ( !passed ) {
+		std::cout << "failed symbol::Dictionary tests." << std::endl;
+	}
+	return passed;
+}
+
+// checks set algebra on a and b, as SymbolSets and as sorted arrays, against the std algorithms.
+bool testSetAlgebra(const char* name, const std::vector<uint64_t>& a, const std::vector<uint64_t>& b) {
+	std::vector<uint64_t> x(a);
+	std::vector<uint64_t> y(b);
+	std::sort(x.begin(), x.end());
+	x.erase(std::unique(x.begin(), x.end()), x.end());
+	std::sort(y.begin(), y.end());
+	y.erase(std::unique(y.begin(), y.end()), y.end());
+	std::vector<uint64_t> both, either, only_x;
+	std::set_intersection(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(both));
+	std::set_union(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(either));
+	std::set_difference(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(only_x));
+
+	bool passed = true;
+	std::vector<uint64_t> out(x.size() + y.size() + 1);
+	const uint64_t* px = x.empty() ? NULL : &x[0];
+	const uint64_t* py = y.empty() ? NULL : &y[0];
+	passed &= std::vector<uint64_t>(&out[0], &out[0] + symbol::intersect(px, x.size(), py, y.size(), &out[0])) == both;
+	passed &= std::vector<uint64_t>(&out[0], &out[0] + symbol::unite(px, x.size(), py, y.size(), &out[0])) == either;
+	passed &= std::vector<uint64_t>(&out[0], &out[0] + symbol::subtract(px, x.size(), py, y.size(), &out[0])) == only_x;
+
+	symbol::SymbolSet sx(a.empty() ? NULL : &a[0], a.size());
+	symbol::SymbolSet sy(b.empty() ? NULL : &b[0], b.size());
+	std::vector<uint64_t> codes;
+	sx.codes(codes);
+	passed &= (codes == x && sx.size() == x.size());
+	sx.intersect(sy).codes(codes);
+	passed &= (codes == both);
+	sx.unite(sy).codes(codes);
+	passed &= (codes == either);
+	sx.subtract(sy).codes(codes);
+	passed &= (codes == only_x);
+	sy.subtract(sx).codes(codes);
+	passed &= (codes.size() == y.size() - both.size());
+	passed &= (sx.intersect(sy) == sy.intersect(sx));
+	passed &= (sx.unite(sy) == symbol::SymbolSet(either.empty() ? NULL : &either[0], either.size()));
+	for ( size_t i = 0; i < y.size(); ++i ) {
+		passed &= (sx.contains(y[i]) == std::binary_search(x.begin(), x.end(), y[i]));
+	}
+
+	if ( verbose || !passed ) {
+		std::cout << "set algebra on " << name << " (" << x.size() << (sx.is_bitmap() ? " bitmap, " : " array, ")
+			<< y.size() << (sy.is_bitmap() ? " bitmap) " : " array) ") << (passed ? "matched." : "DID NOT MATCH!") << std::endl;
+	}
+	return passed;
+}
+
+bool testSymbolSet() {
+	bool passed = true;
+	std::vector<uint64_t> codes = randomCodes(10 + 3000 + 5000 + 200000);
+	std::vector<uint64_t> random[4];
+	const size_t sizes[4] = { 10, 3000, 5000, 200000 };
+	size_t next = 0;
+	for ( int r = 0; r < 4; ++r ) {
+		// a small range so the sets overlap, with duplicates.
+		for ( size_t i = 0; i < sizes[r]; ++i ) random[r].push_back(codes[next++] % 400000);
+	}
+	std::vector<uint64_t> none;
+	passed &= testSetAlgebra("empty sets", none, none);
+	passed &= testSetAlgebra("an empty set", random[1], none);
+	passed &= testSetAlgebra("similar sizes", random[1], random[2]);
+	passed &= testSetAlgebra("a short and a long set", random[0], random[3]);
+	passed &= testSetAlgebra("a long and a short set", random[3], random[1]);
+
+	// dense ranges are stored as bitmaps.
+	std::vector<uint64_t> dense, overlapping, sparse;
+	for ( uint64_t i = 0; i < 5000; ++i ) {
+		dense.push_back(100000 + i);
+		if ( i % 3 ) overlapping.push_back(103000 + i);
+		sparse.push_back(100000 + i * 977);
+	}
+	passed &= testSetAlgebra("dense sets", dense, overlapping);
+	passed &= testSetAlgebra("a dense and a sparse set", dense, sparse);
+	passed &= testSetAlgebra("a sparse and a dense set", sparse, dense);
+	passed &= testSetAlgebra("a dense and a random set", random[3], dense);
+	passed &= symbol::SymbolSet(&dense[0], dense.size()).is_bitmap();
+	passed &= !symbol::SymbolSet(&sparse[0], sparse.size()).is_bitmap();
+
+	// the highest codes make a bitmap whose end doesn't fit in 64 bits.
+	std::vector<uint64_t> top;
+	for ( uint64_t i = 0; i < 100; ++i ) top.push_back(~uint64_t(0) - i);
+	passed &= testSetAlgebra("the highest codes", top, std::vector<uint64_t>(top.begin(), top.begin() + 40));
+
+	// sets of symbols.
+	const char* names[] = { "read", "write", "execute", "read", "delete_everything" };
+	std::vector<symbol::Symbol> symbols;
+	for ( int i = 0; i < 5; ++i ) symbols.push_back(symbol::Symbol(names[i]));
+	symbol::SymbolSet granted(&symbols[0], 3);
+	symbol::SymbolSet requested(&symbols[2], 3);
+	passed &= (granted.size() == 3 && requested.size() == 3);
+	symbol::SymbolSet denied = requested.subtract(granted);
+	passed &= (denied.size() == 1 && denied.contains(symbol::Symbol("delete_everything")));
+	passed &= !denied.contains(symbol::Symbol("read"));
+	passed &= (granted.intersect(requested).size() == 2);
+	passed &= (granted.unite(requested).size() == 4);
+	passed &= (symbol::SymbolSet().unite(granted) == granted);
+
+	if ( !passed ) {
+		std::cout << "failed symbol::SymbolSet tests." << std::endl;
+	}
+	return passed;
+}
+
+// a log site shared by the logging threads.
+static uint32_t thread_site = 0;
+
+void* logEntries(void* log) {
+	for ( int i = 0; i < 1000; ++i ) static_cast<symbol::SymbolLog*>(log)->log(thread_site, numberedKey(i));
+	return NULL;
+}
+
+void* logOnce(void* log) {
+	static_cast<symbol::SymbolLog*>(log)->log(thread_site, numberedKey(0));
+	return NULL;
+}
+
+bool testLog() {
+	bool passed = true;
+	symbol::SymbolLog log(64);
+	const uint32_t lookup = log.site("looked up {} in {}");
+	const uint32_t plain = log.site("no arguments");
+
+	// entries are decoded only when drained.
+	log.log(lookup, symbol::Symbol("key"), symbol::Symbol("globals"));
+	log.log(plain);
+	log.log(plain, symbol::Symbol("extra"));
+	std::ostringstream out;
+	passed &= (log.drain(out) == 3);
+	passed &= (out.str() == "looked up key in globals\nno arguments\nno arguments extra\n");
+	out.str("");
+	passed &= (log.drain(out) == 0 && out.str().empty());
+
+	// a full ring drops entries rather than blocking.
+	for ( int i = 0; i < 100; ++i ) log.log(lookup, numberedKey(i), numberedKey(i + 1));
+	passed &= (log.dropped() == 100 - 64 / 3);
+	passed &= (log.drain(out) == 64 / 3);
+
+	// several threads logging while another drains.
+	symbol::SymbolLog shared(1024);
+	thread_site = shared.site("key {}");
+	pthread_t threads[4];
+	for ( int i = 0; i < 4; ++i ) pthread_create(&threads[i], NULL, logEntries, &shared);
+	size_t drained = 0;
+	std::ostringstream shared_out;
+	for ( int i = 0; i < 100; ++i ) drained += shared.drain(shared_out);
+	for ( int i = 0; i < 4; ++i ) pthread_join(threads[i], NULL);
+	drained += shared.drain(shared_out);
+	passed &= (drained + shared.dropped() == 4000);
+	passed &= (shared_out.str().substr(0, 7) == "key k0\n");
+
+	// rings of exited threads are reused, so short-lived threads never run out.
+	symbol::SymbolLog churn(1024, 2);
+	thread_site = churn.site("key {}");
+	for ( int i = 0; i < 70; ++i ) {
+		pthread_t thread;
+		pthread_create(&thread, NULL, logOnce, &churn);
+		pthread_join(thread, NULL);
+	}
+	passed &= (churn.drain(shared_out) == 70 && churn.dropped() == 0);
+
+	// reserved rings are taken by the first threads to log.
+	symbol::SymbolLog reserved(64, 2);
+	reserved.reserve(5);
+	thread_site = reserved.site("key {}");
+	for ( int i = 0; i < 2; ++i ) pthread_create(&threads[i], NULL, logOnce, &reserved);
+	for ( int i = 0; i < 2; ++i ) pthread_join(threads[i], NULL);
+	passed &= (reserved.drain(shared_out) == 2 && reserved.dropped() == 0);
+
+	// a dump is formatted offline, optionally resolving lossy symbols.
+	const std::string path = "/tmp/test_symbol.log";
+	const std::string dictionary_path = "/tmp/test_symbol.dict";
+	log.log(lookup, symbol::Symbol("a_rather_long_key"), symbol::Symbol("globals"));
+	log.log(plain);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	passed &= log.dump(fd);
+	close(fd);
+	symbol::DictionaryBuilder builder;
+	builder.add("a_rather_long_key");
+	builder.write(dictionary_path);
+	symbol::Dictionary dictionary(dictionary_path);
+	{
+		std::ifstream in(path.c_str(), std::ios::binary);
+		out.str("");
+		passed &= (symbol::format_log(in, out) == 2);
+		passed &= (out.str() == "looked up " + symbol::Symbol("a_rather_long_key").decode() + " in globals\nno arguments\n");
+	}
+	{
+		std::ifstream in(path.c_str(), std::ios::binary);
+		out.str("");
+		passed &= (symbol::format_log(in, out, &dictionary) == 2);
+		passed &= (out.str() == "looked up a_rather_long_key in globals\nno arguments\n");
+	}
+	// dumping doesn't remove anything.
+	out.str("");
+	passed &= (log.drain(out) == 2);
+
+	// truncated dumps are detected.
+	bool caught = false;
+	try {
+		std::istringstream in(std::string("SYMLOG01\x02", 9));
+		symbol::format_log(in, out);
+	} catch ( symbol::LogError& e ) {
+		caught = true;
+	}
+	passed &= caught;
+	remove(path.c_str());
+	remove(dictionary_path.c_str());
+
+	// a log needs a thread-specific key, and says so if none is left.
+	std::vector<pthread_key_t> taken;
+	takeAllKeys(taken);
+	caught = false;
+	try {
+		symbol::SymbolLog keyless;
+	} catch ( symbol::LogError& e ) {
+		caught = true;
+	}
+	returnKeys(taken);
+	passed &= caught;
+
+	if ( !passed ) {
+		std::cout << "failed symbol::SymbolLog tests." << std::endl;
+	}
+	return passed;
+}